@@ -0,0 +1,339 @@
+// BatchRenderer.cpp : Frame-parallel offline rendering.
+//
+
+#include "BatchRenderer.h"
+
+#include <cstring>
+#include <fstream>
+
+BatchRenderer::BatchRenderer(const DepthIllusionConfig& cfg, int width, int height, FrameSink sink,
+    unsigned threadCount, size_t framesInFlight)
+    : config(cfg), width(width), height(height),
+    tilesX((width + TILE_SIZE - 1) / TILE_SIZE), tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+    sink(std::move(sink)), analysisPool(threadCount) {
+    unsigned compositeCount = std::max(1u, threadCount);
+    if (framesInFlight == 0) framesInFlight = compositeCount + 1;
+
+    // Frames wait in their slots until the frames they look ahead to are analysed
+    lookahead = config.temporal_smoothing ? clamp(config.lookahead_frames, 0, MAX_LOOKAHEAD) : 0;
+    framesInFlight += lookahead;
+    if (lookahead) window.Reset(width, height);
+
+    slots.resize(std::max<size_t>(1, framesInFlight));
+    for (Slot& slot : slots) {
+        size_t bytes = static_cast<size_t>(width) * height * 4;
+        slot.pixels.resize(bytes);
+        slot.blurred.resize(bytes);
+        slot.overlay.resize(bytes);
+        slot.tileFlat.resize(static_cast<size_t>(tilesX) * tilesY);
+        freeSlots.push_back(&slot);
+    }
+
+    BuildAnalysisGraph();
+    BuildWindowGraph();
+    for (unsigned i = 0; i < compositeCount; i++) {
+        compositeThreads.emplace_back(&BatchRenderer::CompositeLoop, this);
+    }
+}
+
+BatchRenderer::~BatchRenderer() {
+    Finish();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shutdown = true;
+    }
+    workQueued.notify_all();
+    for (auto& thread : compositeThreads) thread.join();
+}
+
+// Same per-tile chain as the analysis half of TileRenderer, at full detail
+void BatchRenderer::BuildAnalysisGraph() {
+    for (int tileY = 0; tileY < tilesY; tileY++) {
+        for (int tileX = 0; tileX < tilesX; tileX++) {
+            int x0 = tileX * TILE_SIZE, x1 = std::min(width, x0 + TILE_SIZE);
+            int y0 = tileY * TILE_SIZE, y1 = std::min(height, y0 + TILE_SIZE);
+            int tile = tileY * tilesX + tileX;
+
+            int edges = analysisGraph.AddTask([=] {
+                const uint8_t* pixels = analysing->pixels.data();
+                analysing->tileFlat[tile] = IsFlatRegion(pixels, width, height, x0, y0, x1, y1, 3, config.flat_threshold);
+                depthGen.DetectEdges(pixels, x0, y0, x1, y1, 1, analysing->tileFlat[tile] != 0);
+            });
+            int depth = analysisGraph.AddTask([=] { depthGen.EstimateDepth(x0, y0, x1, y1); });
+            int smooth = analysisGraph.AddTask([=] { depthGen.SmoothDepth(x0, y0, x1, y1); });
+            analysisGraph.AddDependency(edges, depth);
+            analysisGraph.AddDependency(depth, smooth);
+        }
+    }
+}
+
+// Window updates are independent per row, so bands of rows run in parallel
+void BatchRenderer::BuildWindowGraph() {
+    for (int y0 = 0; y0 < height; y0 += TILE_SIZE) {
+        int y1 = std::min(height, y0 + TILE_SIZE);
+        windowGraph.AddTask([=] {
+            switch (windowOp) {
+            case WindowOp::Add: window.AddRows(depthGen.depthMap, y0, y1); break;
+            case WindowOp::Remove: window.RemoveOldestRows(y0, y1); break;
+            case WindowOp::Average: window.AverageRows(windowTarget->depthMap, y0, y1); break;
+            }
+        });
+    }
+}
+
+void BatchRenderer::RunWindowOp(WindowOp op, Slot* target) {
+    windowOp = op;
+    windowTarget = target;
+    analysisPool.Run(windowGraph);
+}
+
+// Adds the depth map just analysed to the window, then averages every frame whose
+// look-ahead is now complete
+void BatchRenderer::AddToWindow(Slot* slot) {
+    window.PushNewest();
+    RunWindowOp(WindowOp::Add);
+    windowFrames.push_back(slot);
+    while (windowCenter < windowFrames.size() && windowFrames.size() - 1 - windowCenter >= static_cast<size_t>(lookahead)) {
+        EmitWindowFrame();
+    }
+}
+
+void BatchRenderer::EmitWindowFrame() {
+    // The window reaches lookahead frames back from the frame being averaged
+    while (windowCenter > static_cast<size_t>(lookahead)) {
+        RunWindowOp(WindowOp::Remove);
+        window.PopOldest();
+        windowFrames.pop_front();
+        windowCenter--;
+    }
+
+    Slot* slot = windowFrames[windowCenter];
+    windowFrames[windowCenter++] = nullptr;
+    if (!slot) return;
+
+    RunWindowOp(WindowOp::Average, slot);
+    QueueForComposite(slot);
+}
+
+bool BatchRenderer::Submit(const FrameView& view) {
+    if (view.width != width || view.height != height) return false;
+
+    FrameBuffer buffer = Acquire();
+    if (!buffer.pixels) return false;
+    CopyFrame(view, buffer.pixels);
+    return Submit(buffer, view.timestamp);
+}
+
+BatchRenderer::FrameBuffer BatchRenderer::Acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    slotFreed.wait(lock, [&] { return failed || !freeSlots.empty(); });
+    if (failed) return FrameBuffer();
+
+    Slot* slot = freeSlots.back();
+    freeSlots.pop_back();
+    FrameBuffer buffer;
+    buffer.pixels = slot->pixels.data();
+    buffer.slot = slot;
+    return buffer;
+}
+
+void BatchRenderer::Release(FrameBuffer buffer) {
+    if (!buffer.slot) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeSlots.push_back(static_cast<Slot*>(buffer.slot));
+    }
+    slotFreed.notify_all();
+}
+
+bool BatchRenderer::Submit(FrameBuffer buffer, std::chrono::microseconds timestamp) {
+    Slot* slot = static_cast<Slot*>(buffer.slot);
+    if (!slot) return false;
+
+    slot->index = submitted++;
+    slot->timestamp = timestamp;
+    slot->phase = phase;
+    Analyse(slot);
+
+    if (lookahead) {
+        if (slot->depthMap.size() != static_cast<size_t>(height)) {
+            slot->depthMap.assign(height, std::vector<float>(width, 0.0f));
+        }
+        AddToWindow(slot);
+    }
+    else {
+        slot->depthMap = depthGen.depthMap;
+        QueueForComposite(slot);
+    }
+    return true;
+}
+
+void BatchRenderer::QueueForComposite(Slot* slot) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(slot);
+    }
+    workQueued.notify_one();
+}
+
+void BatchRenderer::Analyse(Slot* slot) {
+    // Offline rendering always analyses whole frames. With look-ahead the generator only
+    // estimates depth; the window does the smoothing.
+    DepthIllusionConfig frameConfig = config;
+    frameConfig.interlace_frames = 1;
+    if (lookahead) {
+        frameConfig.temporal_smoothing = false;
+        frameConfig.history_frames = 0;
+    }
+
+    analysing = slot;
+    depthGen.BeginFrame(frameConfig, width, height);
+    analysisPool.Run(analysisGraph);
+    depthGen.EndFrame();
+    analysing = nullptr;
+
+    // Animation phase advances once per frame, as in the live pipeline
+    phase += config.phase_speed;
+}
+
+bool BatchRenderer::WarmUp(const FrameView& view) {
+    if (view.width != width || view.height != height) return false;
+
+    FrameBuffer buffer = Acquire();
+    if (!buffer.pixels) return false;
+    CopyFrame(view, buffer.pixels);
+    Analyse(static_cast<Slot*>(buffer.slot));
+    Release(buffer);
+    if (lookahead) AddToWindow(nullptr);
+    return true;
+}
+
+bool BatchRenderer::SetNextIndex(unsigned long long index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (nextDelivery != submitted) return false;
+    submitted = nextDelivery = index;
+    return true;
+}
+
+// Checkpoint layout: "T3DCKPT1", next frame index (uint64), phase (float), then the
+// generator state
+static const char CHECKPOINT_MAGIC[8] = { 'T', '3', 'D', 'C', 'K', 'P', 'T', '1' };
+
+bool BatchRenderer::SaveCheckpoint(const std::string& path) {
+    if (lookahead || !Finish()) return false;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    uint64_t index = submitted;
+    file.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    file.write(reinterpret_cast<const char*>(&index), sizeof(index));
+    file.write(reinterpret_cast<const char*>(&phase), sizeof(phase));
+    return depthGen.SaveState(file) && file.good();
+}
+
+bool BatchRenderer::LoadCheckpoint(const std::string& path) {
+    if (lookahead) return false;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    char magic[8] = {};
+    uint64_t index = 0;
+    float savedPhase = 0.0f;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&index), sizeof(index));
+    file.read(reinterpret_cast<char*>(&savedPhase), sizeof(savedPhase));
+    if (!file.good() || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) return false;
+
+    // Nothing changes unless the whole checkpoint is valid: the generator only takes
+    // state that matches this frame size, and the index moves after that
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (nextDelivery != submitted) return false;
+    }
+    if (!depthGen.LoadState(file, width, height) || !SetNextIndex(index)) return false;
+
+    phase = savedPhase;
+    return true;
+}
+
+bool BatchRenderer::Finish() {
+    // The end of the input: the last frames are averaged over what future they have
+    while (lookahead && windowCenter < windowFrames.size()) EmitWindowFrame();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    delivered.wait(lock, [&] { return failed || nextDelivery == submitted; });
+    return !failed;
+}
+
+void BatchRenderer::CompositeLoop() {
+    while (true) {
+        Slot* slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workQueued.wait(lock, [&] { return shutdown || !pending.empty(); });
+            if (pending.empty()) return;
+            slot = pending.front();
+            pending.pop_front();
+        }
+
+        Composite(*slot);
+        Deliver(slot);
+    }
+}
+
+void BatchRenderer::Composite(Slot& slot) {
+    for (int tileY = 0; tileY < tilesY; tileY++) {
+        for (int tileX = 0; tileX < tilesX; tileX++) {
+            int x0 = tileX * TILE_SIZE, x1 = std::min(width, x0 + TILE_SIZE);
+            int y0 = tileY * TILE_SIZE, y1 = std::min(height, y0 + TILE_SIZE);
+            if (slot.tileFlat[tileY * tilesX + tileX]) {
+                CopyTile(slot.pixels.data(), slot.blurred.data(), width, x0, y0, x1, y1);
+            }
+            else {
+                ApplyDepthBlurTile(config, slot.pixels.data(), slot.blurred.data(), width, height,
+                    slot.depthMap, x0, y0, x1, y1);
+            }
+        }
+    }
+
+    CompositeDepthTile(config, slot.blurred.data(), slot.overlay.data(), width, height,
+        slot.depthMap, slot.phase, 0, 0, width, height);
+}
+
+// Frames finish out of order; whichever thread completes the next frame due delivers
+// it, and every completed frame queued behind it, before anyone else may
+void BatchRenderer::Deliver(Slot* slot) {
+    std::unique_lock<std::mutex> lock(mutex);
+    completed[slot->index] = slot;
+    if (delivering) return;
+    delivering = true;
+
+    while (!completed.empty() && completed.begin()->first == nextDelivery) {
+        Slot* next = completed.begin()->second;
+        completed.erase(completed.begin());
+
+        bool ok = true;
+        if (!failed) {
+            lock.unlock();
+            RenderedFrame frame;
+            frame.index = next->index;
+            frame.timestamp = next->timestamp;
+            frame.width = width;
+            frame.height = height;
+            frame.source = next->pixels.data();
+            frame.overlay = next->overlay.data();
+            frame.depthMap = &next->depthMap;
+            ok = sink(frame);
+            lock.lock();
+        }
+
+        if (!ok) failed = true;
+        nextDelivery++;
+        freeSlots.push_back(next);
+        slotFreed.notify_all();
+        delivered.notify_all();
+    }
+    delivering = false;
+}
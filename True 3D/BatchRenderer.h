@@ -0,0 +1,162 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "DepthPipeline.h"
+#include "FrameSource.h"
+
+// A finished frame as handed to a BatchRenderer sink. The pointers are only valid
+// during the sink call.
+struct RenderedFrame {
+    unsigned long long index = 0;
+    std::chrono::microseconds timestamp{ 0 };
+    int width = 0;
+    int height = 0;
+    const uint8_t* source = nullptr;                          // The submitted frame, width x height BGRA
+    const uint8_t* overlay = nullptr;                         // width x height BGRA
+    const std::vector<std::vector<float>>* depthMap = nullptr; // height rows of width values in [0, 1]
+};
+
+// Offline rendering of frame sequences at full quality. Analysis keeps the causal order
+// temporal smoothing needs: frame N is analysed, tile-parallel, only once frame N-1 is.
+// Blur and compositing read nothing but their own frame and depth map, so they run on
+// separate threads with several frames in flight behind the analysis, which keeps every
+// core busy even though the history is sequential.
+//
+// render_scale, foveation, interlacing and region masks trade quality for frame rate
+// and do not apply here; frames are always analysed and composited in full.
+//
+// With lookahead_frames set, temporal smoothing is the symmetric average of
+// DepthWindowAccumulator instead of the causal history. Analysis then no longer depends
+// on earlier frames' results; a frame is composited once the lookahead_frames after
+// it have been analysed, or when Finish marks the end of the input.
+class BatchRenderer {
+public:
+    // Receives frames in index order; calls never overlap. Returning false stops the
+    // render: Submit and Finish then return false.
+    using FrameSink = std::function<bool(const RenderedFrame&)>;
+
+    // framesInFlight 0 picks one per composite thread plus one being analysed
+    BatchRenderer(const DepthIllusionConfig& cfg, int width, int height, FrameSink sink,
+        unsigned threadCount = std::thread::hardware_concurrency(), size_t framesInFlight = 0);
+    ~BatchRenderer();
+
+    BatchRenderer(const BatchRenderer&) = delete;
+    BatchRenderer& operator=(const BatchRenderer&) = delete;
+
+    // Analyses a frame and queues it for compositing. Blocks while every frame slot is
+    // in use. The view must match the renderer's size.
+    bool Submit(const FrameView& view);
+
+    // Zero-copy submission in two steps: Acquire reserves a frame slot and returns its
+    // tightly packed BGRA buffer, which any thread may fill (e.g. a reader decoding
+    // straight into it); Submit then analyses it on the calling thread. Acquire blocks
+    // while every slot is in use and returns a null buffer once the sink has failed.
+    // A buffer that will not be submitted goes back with Release.
+    struct FrameBuffer {
+        uint8_t* pixels = nullptr;
+        void* slot = nullptr;
+    };
+    FrameBuffer Acquire();
+    bool Submit(FrameBuffer buffer, std::chrono::microseconds timestamp);
+    void Release(FrameBuffer buffer);
+
+    // Blocks until every submitted frame has been delivered to the sink. Call it from
+    // the submitting thread.
+    bool Finish();
+
+    unsigned long long FramesSubmitted() const { return submitted; }
+
+    // Animation phase the next submitted frame is composited with
+    float Phase() const { return phase; }
+    void SetPhase(float value) { phase = value; }
+
+    // Analyses a frame only to advance the temporal history and the phase, e.g. on the
+    // frames before a shard; nothing is composited, delivered or counted. With
+    // look-ahead, frames warmed up after the last Submit serve as the future of the
+    // last submitted frames.
+    bool WarmUp(const FrameView& view);
+
+    // Index the next submitted frame gets; false while frames are in flight
+    bool SetNextIndex(unsigned long long index);
+
+    // A checkpoint holds everything the next frame depends on besides its own pixels:
+    // the generator's temporal state, the phase and the next frame index. Save after
+    // Finish and load before the next Submit; false while frames are in flight, on I/O
+    // errors and with look-ahead, where warming up on lookahead_frames frames restores
+    // the state exactly.
+    bool SaveCheckpoint(const std::string& path);
+    bool LoadCheckpoint(const std::string& path);
+
+    AdvancedDepthGenerator& Generator() { return depthGen; }
+
+private:
+    struct Slot {
+        unsigned long long index = 0;
+        std::chrono::microseconds timestamp{ 0 };
+        float phase = 0.0f;
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> blurred;
+        std::vector<uint8_t> overlay;
+        std::vector<std::vector<float>> depthMap;
+        std::vector<uint8_t> tileFlat;
+    };
+
+    enum class WindowOp { Add, Remove, Average };
+
+    void BuildAnalysisGraph();
+    void BuildWindowGraph();
+    void Analyse(Slot* slot);
+    void RunWindowOp(WindowOp op, Slot* target = nullptr);
+    void AddToWindow(Slot* slot);
+    void EmitWindowFrame();
+    void QueueForComposite(Slot* slot);
+    void CompositeLoop();
+    void Composite(Slot& slot);
+    void Deliver(Slot* slot);
+
+    DepthIllusionConfig config;
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+    FrameSink sink;
+
+    AdvancedDepthGenerator depthGen;
+    WorkStealingPool analysisPool;
+    TaskGraph analysisGraph;
+    Slot* analysing = nullptr;  // Slot the analysis graph is running on
+    float phase = 0.0f;
+    unsigned long long submitted = 0;
+
+    // Look-ahead smoothing; only the submitting thread touches these
+    static const int MAX_LOOKAHEAD = 511;
+    int lookahead = 0;
+    DepthWindowAccumulator window;
+    std::deque<Slot*> windowFrames;  // One per map in the window, oldest first; null once averaged or for warm-up frames
+    size_t windowCenter = 0;         // Next frame in windowFrames to be averaged
+    TaskGraph windowGraph;
+    WindowOp windowOp = WindowOp::Add;
+    Slot* windowTarget = nullptr;
+
+    std::vector<Slot> slots;
+    std::vector<std::thread> compositeThreads;
+    std::mutex mutex;
+    std::condition_variable slotFreed;   // A slot went back to freeSlots, or the sink failed
+    std::condition_variable workQueued;  // A slot was added to pending, or shutdown
+    std::condition_variable delivered;   // nextDelivery advanced
+    std::vector<Slot*> freeSlots;
+    std::deque<Slot*> pending;           // Analysed, waiting for a composite thread
+    std::map<unsigned long long, Slot*> completed;  // Composited, waiting for their turn
+    unsigned long long nextDelivery = 0;
+    bool delivering = false;
+    bool failed = false;
+    bool shutdown = false;
+};
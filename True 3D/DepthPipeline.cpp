@@ -0,0 +1,736 @@
+// DepthPipeline.cpp : Depth analysis, blur and compositing kernels.
+//
+
+#include "DepthPipeline.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void HSVtoRGB(float h, float s, float v, float& r, float& g, float& b) {
+    if (s == 0.0f) {
+        r = g = b = v;
+        return;
+    }
+
+    h = std::fmod(h, 1.0f) * 6.0f;
+    int i = static_cast<int>(h);
+    float f = h - i;
+    float p = v * (1.0f - s);
+    float q = v * (1.0f - s * f);
+    float t = v * (1.0f - s * (1.0f - f));
+
+    switch (i) {
+    case 0: r = v; g = t; b = p; break;
+    case 1: r = q; g = v; b = p; break;
+    case 2: r = p; g = v; b = t; break;
+    case 3: r = p; g = q; b = v; break;
+    case 4: r = t; g = p; b = v; break;
+    default: r = v; g = p; b = q; break;
+    }
+}
+
+void ApplyIridescence(const DepthIllusionConfig& cfg, int x, int y, float depth, float time, uint8_t& r, uint8_t& g, uint8_t& b) {
+    // Base hue derived from position and depth
+    float hue = std::fmod(
+        cfg.hue_offset +
+        x * cfg.iridescence_scale +
+        y * cfg.iridescence_scale * 0.7f +
+        depth * 0.3f +
+        time * cfg.iridescence_speed,
+        1.0f
+    ) * cfg.hue_range;
+
+    // Convert original RGB to floats
+    float origR = r / 255.0f;
+    float origG = g / 255.0f;
+    float origB = b / 255.0f;
+
+    // Generate iridescent color
+    float iriR, iriG, iriB;
+    HSVtoRGB(hue, 0.9f, 0.9f, iriR, iriG, iriB);
+
+    // Blend with original color based on depth and intensity
+    float blendFactor = depth * cfg.iridescence_intensity;
+
+    r = static_cast<uint8_t>(clamp((origR * (1.0f - blendFactor) + iriR * blendFactor) * 255.0f, 0.0f, 255.0f));
+    g = static_cast<uint8_t>(clamp((origG * (1.0f - blendFactor) + iriG * blendFactor) * 255.0f, 0.0f, 255.0f));
+    b = static_cast<uint8_t>(clamp((origB * (1.0f - blendFactor) + iriB * blendFactor) * 255.0f, 0.0f, 255.0f));
+}
+
+void DepthWindowAccumulator::Reset(int frameWidth, int frameHeight) {
+    width = frameWidth;
+    height = frameHeight;
+    while (!maps.empty()) PopOldest();
+    sum.assign(static_cast<size_t>(width) * height, 0);
+}
+
+void DepthWindowAccumulator::PushNewest() {
+    if (!spare.empty()) {
+        maps.push_back(std::move(spare.back()));
+        spare.pop_back();
+    }
+    else {
+        maps.emplace_back();
+    }
+    maps.back().resize(static_cast<size_t>(width) * height);
+}
+
+void DepthWindowAccumulator::AddRows(const std::vector<std::vector<float>>& depthMap, int y0, int y1) {
+    const float scale = static_cast<float>(1 << FRACTION_BITS);
+    for (int y = y0; y < y1; y++) {
+        uint32_t* fixed = maps.back().data() + static_cast<size_t>(y) * width;
+        uint32_t* total = sum.data() + static_cast<size_t>(y) * width;
+        const float* row = depthMap[y].data();
+        for (int x = 0; x < width; x++) {
+            fixed[x] = static_cast<uint32_t>(clamp(row[x], 0.0f, 1.0f) * scale + 0.5f);
+            total[x] += fixed[x];
+        }
+    }
+}
+
+void DepthWindowAccumulator::RemoveOldestRows(int y0, int y1) {
+    for (int y = y0; y < y1; y++) {
+        const uint32_t* fixed = maps.front().data() + static_cast<size_t>(y) * width;
+        uint32_t* total = sum.data() + static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; x++) total[x] -= fixed[x];
+    }
+}
+
+void DepthWindowAccumulator::PopOldest() {
+    spare.push_back(std::move(maps.front()));
+    maps.pop_front();
+}
+
+void DepthWindowAccumulator::AverageRows(std::vector<std::vector<float>>& depthMap, int y0, int y1) const {
+    if (maps.empty()) return;
+    const float scale = 1.0f / (static_cast<float>(maps.size()) * static_cast<float>(1 << FRACTION_BITS));
+    for (int y = y0; y < y1; y++) {
+        const uint32_t* total = sum.data() + static_cast<size_t>(y) * width;
+        float* row = depthMap[y].data();
+        for (int x = 0; x < width; x++) row[x] = static_cast<float>(total[x]) * scale;
+    }
+}
+
+bool IsFlatRegion(const uint8_t* pixels, int width, int height, int x0, int y0, int x1, int y1,
+    int margin, int threshold) {
+    if (threshold < 0) return false;
+    x0 = std::max(0, x0 - margin);
+    y0 = std::max(0, y0 - margin);
+    x1 = std::min(width, x1 + margin);
+    y1 = std::min(height, y1 + margin);
+
+    uint8_t low[3], high[3];
+    for (int c = 0; c < 3; c++) low[c] = high[c] = pixels[(y0 * width + x0) * 4 + c];
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t* row = pixels + (y * width) * 4;
+        for (int x = x0; x < x1; x++) {
+            for (int c = 0; c < 3; c++) {
+                low[c] = std::min(low[c], row[x * 4 + c]);
+                high[c] = std::max(high[c], row[x * 4 + c]);
+            }
+        }
+
+        // Bail out per row: textured tiles are usually detected within a few rows
+        for (int c = 0; c < 3; c++) {
+            if (high[c] - low[c] > threshold) return false;
+        }
+    }
+    return true;
+}
+
+void CopyTile(const uint8_t* src, uint8_t* dst, int width, int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+        memcpy(dst + (y * width + x0) * 4, src + (y * width + x0) * 4, (x1 - x0) * 4);
+    }
+}
+
+// Gaussian-like blur weights for radius 1-3, [radius][(j + 3) * 7 + (i + 3)]. They do not
+// depend on the config, so they are computed once instead of per tap.
+struct BlurKernelTable {
+    float weights[4][49] = {};
+
+    BlurKernelTable() {
+        for (int radius = 1; radius <= 3; radius++) {
+            for (int j = -radius; j <= radius; j++) {
+                for (int i = -radius; i <= radius; i++) {
+                    weights[radius][(j + 3) * 7 + (i + 3)] = std::exp(-(i * i + j * j) / (2.0f * radius * radius));
+                }
+            }
+        }
+    }
+} const g_blurKernel;
+
+void ApplyDepthBlurTile(const DepthIllusionConfig& cfg, const uint8_t* src, uint8_t* dst, int width, int height,
+    const std::vector<std::vector<float>>& depthMap, int x0, int y0, int x1, int y1, int step) {
+    CopyTile(src, dst, width, x0, y0, x1, y1);
+
+    const float blurScale = cfg.blur_radius;
+    if (blurScale < 1.0f) return; // Depth never exceeds 1, so no pixel would get a radius
+
+    // Simple gaussian-like blur with variable radius based on depth
+    const int rowEnd = std::min(y1, height - 2);
+    const int columnEnd = std::min(x1, width - 2);
+    for (int y = std::max(y0, 2); y < rowEnd; y += step) {
+        for (int x = std::max(x0, 2); x < columnEnd; x += step) {
+            float depth = depthMap[y][x];
+            int blurRadius = static_cast<int>(depth * blurScale);
+            if (blurRadius == 0) continue;
+
+            blurRadius = std::min(blurRadius, 3); // Limit blur radius
+
+            float totalR = 0, totalG = 0, totalB = 0;
+            float totalWeight = 0;
+
+            for (int j = -blurRadius; j <= blurRadius; j++) {
+                for (int i = -blurRadius; i <= blurRadius; i++) {
+                    int nx = x + i;
+                    int ny = y + j;
+
+                    if (nx < 0 || nx >= width || ny < 0 || ny >= height) continue;
+
+                    // Gaussian-like weight
+                    float weight = g_blurKernel.weights[blurRadius][(j + 3) * 7 + (i + 3)];
+
+                    int offset = (ny * width + nx) * 4;
+                    totalR += src[offset + 2] * weight;
+                    totalG += src[offset + 1] * weight;
+                    totalB += src[offset] * weight;
+                    totalWeight += weight;
+                }
+            }
+
+            int offset = (y * width + x) * 4;
+            dst[offset + 2] = static_cast<uint8_t>(totalR / totalWeight);
+            dst[offset + 1] = static_cast<uint8_t>(totalG / totalWeight);
+            dst[offset] = static_cast<uint8_t>(totalB / totalWeight);
+
+            if (step > 1) {
+                for (int by = y; by < std::min(y + step, rowEnd); by++) {
+                    for (int bx = x; bx < std::min(x + step, columnEnd); bx++) {
+                        memcpy(dst + (by * width + bx) * 4, dst + offset, 3);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void ApplyDepthBlur(const DepthIllusionConfig& cfg, uint8_t* pixels, int width, int height,
+    const std::vector<std::vector<float>>& depthMap) {
+    std::vector<uint8_t> tempBuffer(width * height * 4);
+    memcpy(tempBuffer.data(), pixels, width * height * 4);
+
+    ApplyDepthBlurTile(cfg, tempBuffer.data(), pixels, width, height, depthMap, 0, 0, width, height);
+}
+
+// Per-pixel state threaded through the composite effect stages
+struct CompositeContext {
+    const DepthIllusionConfig& cfg;
+    const uint8_t* src;   // Blurred frame
+    int width, height;    // Source frame size
+    float depth;
+    float phase;
+    int x, y;          // Screen position being composited
+    int srcX, srcY;    // Displaced source position
+    uint8_t* out;         // BGRA overlay pixel
+};
+
+// Moves the sampling position by depth, perspective and (optionally) the wave pattern
+template <bool Wave>
+struct DisplacementStage {
+    static void Apply(CompositeContext& c) {
+        const DepthIllusionConfig& cfg = c.cfg;
+        float time = c.phase;
+        float perspective = 1.0f - (c.y / float(c.height)) * cfg.perspective_strength;
+
+        // Wave effect
+        float wave = 0.0f;
+        if (Wave) {
+            wave = std::sin(c.x * cfg.wave_frequency + time) *
+                std::cos(c.y * cfg.wave_frequency * 0.7f + time * 0.8f) *
+                cfg.wave_amplitude * c.depth;
+        }
+
+        // Combined displacements
+        float shiftX = (cfg.base_shift * c.depth * perspective + wave) * std::sin(c.phase);
+        float shiftY = (cfg.vertical_shift * c.depth * perspective + wave * 0.7f) * std::cos(c.phase);
+
+        // Areas outside focus range get more extreme effect
+        float focusEffect = std::abs(c.depth - cfg.focus_distance) > cfg.focus_range ? 0.6f : 1.0f;
+
+        c.srcX = clamp(c.x + static_cast<int>(shiftX * focusEffect), 0, c.width - 1);
+        c.srcY = clamp(c.y + static_cast<int>(shiftY * focusEffect), 0, c.height - 1);
+    }
+};
+
+// Samples the colour at the displaced position, splitting red and blue apart by depth
+template <bool Enabled>
+struct ChromaticAberrationStage {
+    static void Apply(CompositeContext& c) {
+        const uint8_t* row = c.src + c.srcY * c.width * 4;
+        if (!Enabled) {
+            memcpy(c.out, row + c.srcX * 4, 3);
+            return;
+        }
+
+        // Enhanced color separation (chromatic aberration)
+        float colorSep = c.depth * c.cfg.color_intensity;
+        int redX = clamp(c.srcX + static_cast<int>(colorSep * 3.0f), 0, c.width - 1);
+        int blueX = clamp(c.srcX - static_cast<int>(colorSep * 3.0f), 0, c.width - 1);
+
+        c.out[2] = static_cast<uint8_t>(clamp(row[redX * 4 + 2] * (1.0f + colorSep * 0.5f), 0.0f, 255.0f)); // Red
+        c.out[1] = row[c.srcX * 4 + 1]; // Green stays at source position
+        c.out[0] = static_cast<uint8_t>(clamp(row[blueX * 4 + 0] * (1.0f + colorSep * 0.3f), 0.0f, 255.0f)); // Blue
+    }
+};
+
+template <bool Enabled>
+struct IridescenceStage {
+    static void Apply(CompositeContext& c) {
+        if (Enabled) {
+            ApplyIridescence(c.cfg, c.x, c.y, c.depth, c.phase,
+                c.out[2],  // Red
+                c.out[1],  // Green
+                c.out[0]); // Blue
+        }
+    }
+};
+
+struct DepthAlphaStage {
+    static void Apply(CompositeContext& c) {
+        float depthAlpha = 0.3f + c.depth * 0.7f; // More transparent for areas with less depth
+        c.out[3] = static_cast<uint8_t>(c.cfg.alpha * depthAlpha);
+    }
+};
+
+// Runs its stages in order; the whole chain inlines into a single kernel
+template <typename... Stages>
+struct EffectChain;
+
+template <>
+struct EffectChain<> {
+    static void Apply(CompositeContext&) {}
+};
+
+template <typename First, typename... Rest>
+struct EffectChain<First, Rest...> {
+    static void Apply(CompositeContext& c) {
+        First::Apply(c);
+        EffectChain<Rest...>::Apply(c);
+    }
+};
+
+template <bool Wave, bool Chromatic, bool Iridescent>
+using CompositeEffects = EffectChain<DisplacementStage<Wave>, ChromaticAberrationStage<Chromatic>,
+    IridescenceStage<Iridescent>, DepthAlphaStage>;
+
+// Composites the [lx0, lx1) x [ly0, ly1) rectangle of a reduced-resolution overlay that is
+// dstWidth pixels wide. Reduced pixel (lx, ly) samples screen position (sampleX[lx], sampleY[ly]).
+// A step above 1 composites one pixel per step x step block of the overlay and fills the block.
+// Reads the blurred frame from src at displaced positions, so src must be complete within
+// the displacement halo.
+template <typename Effects>
+void CompositeTileKernel(const DepthIllusionConfig& config, const uint8_t* src, int width, int height,
+    uint8_t* dst, int dstWidth,
+    const std::vector<std::vector<float>>& depthMap, float phase, const int* sampleX, const int* sampleY,
+    int lx0, int ly0, int lx1, int ly1, int step) {
+    // Local copy: the char-typed dst stores may alias config, which would force every
+    // field to be reloaded per pixel
+    const DepthIllusionConfig cfg = config;
+
+    for (int ly = ly0; ly < ly1; ly += step) {
+        int y = sampleY[ly];
+        for (int lx = lx0; lx < lx1; lx += step) {
+            int x = sampleX[lx];
+            CompositeContext context = { cfg, src, width, height, depthMap[y][x], phase, x, y, x, y,
+                dst + (ly * dstWidth + lx) * 4 };
+            Effects::Apply(context);
+
+            if (step > 1) {
+                for (int by = ly; by < std::min(ly + step, ly1); by++) {
+                    for (int bx = lx; bx < std::min(lx + step, lx1); bx++) {
+                        memcpy(dst + (by * dstWidth + bx) * 4, context.out, 4);
+                    }
+                }
+            }
+        }
+    }
+}
+
+CompositeTileFn SelectCompositeKernel(const DepthIllusionConfig& cfg) {
+    static const CompositeTileFn kernels[8] = {
+        &CompositeTileKernel<CompositeEffects<false, false, false>>,
+        &CompositeTileKernel<CompositeEffects<true, false, false>>,
+        &CompositeTileKernel<CompositeEffects<false, true, false>>,
+        &CompositeTileKernel<CompositeEffects<true, true, false>>,
+        &CompositeTileKernel<CompositeEffects<false, false, true>>,
+        &CompositeTileKernel<CompositeEffects<true, false, true>>,
+        &CompositeTileKernel<CompositeEffects<false, true, true>>,
+        &CompositeTileKernel<CompositeEffects<true, true, true>>,
+    };
+
+    int index = (cfg.wave_amplitude != 0.0f ? 1 : 0) |
+        (cfg.color_intensity != 0.0f ? 2 : 0) |
+        (cfg.enable_iridescence ? 4 : 0);
+    return kernels[index];
+}
+
+// Table mapping every index below count to itself; grown on demand and kept per thread,
+// so full-resolution composites serve both axes from it without rebuilding anything
+static const int* IdentitySamples(int count) {
+    thread_local std::vector<int> identity;
+    int size = static_cast<int>(identity.size());
+    if (size < count) {
+        identity.resize(count);
+        for (int i = size; i < count; i++) identity[i] = i;
+    }
+    return identity.data();
+}
+
+void CompositeDepthTile(const DepthIllusionConfig& cfg, const uint8_t* src, uint8_t* dst, int width, int height,
+    const std::vector<std::vector<float>>& depthMap, float phase, int x0, int y0, int x1, int y1) {
+    const int* identity = IdentitySamples(std::max(x1, y1));
+    SelectCompositeKernel(cfg)(cfg, src, width, height, dst, width, depthMap, phase,
+        identity, identity, x0, y0, x1, y1, 1);
+}
+
+void CompositeHalo(const DepthIllusionConfig& cfg, int& haloX, int& haloY) {
+    float perspective = std::max(1.0f, std::abs(1.0f - cfg.perspective_strength));
+    float wave = std::abs(cfg.wave_amplitude);
+    haloX = static_cast<int>(std::ceil(std::abs(cfg.base_shift) * perspective + wave +
+        std::abs(cfg.color_intensity) * 3.0f)) + 1;
+    haloY = static_cast<int>(std::ceil(std::abs(cfg.vertical_shift) * perspective + wave * 0.7f)) + 1;
+}
+
+bool StageInputsEqual(RenderStage stage, const DepthIllusionConfig& a, const DepthIllusionConfig& b) {
+    using C = DepthIllusionConfig;
+    switch (stage) {
+    case STAGE_EDGES:
+        return SameFields(a, b, &C::edge_boost, &C::edge_kernel_mode, &C::flat_threshold,
+            &C::interlace_frames, &C::interlace_checkerboard,
+            &C::foveated, &C::fovea_follow_cursor, &C::fovea_radius, &C::fovea_max_step);
+    case STAGE_DEPTH:
+        return SameFields(a, b, &C::texture_influence, &C::luminance_influence,
+            &C::focus_distance, &C::focus_range, &C::depth_intensity);
+    case STAGE_SMOOTHING:
+        return SameFields(a, b, &C::temporal_smoothing, &C::history_frames);
+    case STAGE_BLUR:
+        return SameFields(a, b, &C::blur_radius);
+    case STAGE_COMPOSITE:
+        return SameFields(a, b, &C::base_shift, &C::vertical_shift, &C::perspective_strength,
+            &C::focus_distance, &C::focus_range, &C::color_intensity, &C::wave_amplitude, &C::wave_frequency,
+            &C::enable_iridescence, &C::iridescence_intensity, &C::iridescence_speed, &C::iridescence_scale,
+            &C::hue_range, &C::hue_offset, &C::alpha, &C::render_scale);
+    default:
+        return true;
+    }
+}
+
+unsigned long long HashFrame(const uint8_t* data, size_t size) {
+    const unsigned long long prime = 0x9E3779B97F4A7C15ull;
+    unsigned long long lanes[4] = { 1, 2, 3, 4 };
+    size_t words = size / 8;
+    size_t i = 0;
+
+    // Four independent lanes keep the multiplies pipelined
+    for (; i + 4 <= words; i += 4) {
+        for (int lane = 0; lane < 4; lane++) {
+            unsigned long long word;
+            memcpy(&word, data + (i + lane) * 8, 8);
+            lanes[lane] = (lanes[lane] ^ word) * prime;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+    for (size_t tail = i * 8; tail < size; tail++) {
+        lanes[0] = (lanes[0] ^ data[tail]) * prime;
+    }
+
+    unsigned long long hash = size;
+    for (unsigned long long lane : lanes) {
+        hash = (hash ^ lane) * prime;
+        hash ^= hash >> 31;
+    }
+    return hash;
+}
+
+void BilinearUpscaler::ExpandRow(const uint8_t* row, int srcWidth, uint16_t* out) const {
+    int x = 0;
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+    // Gathers four left and four right pixels, then weights them two pixels per register.
+    // Each product is at most 255 * 256, so 16-bit lanes hold it exactly.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(256);
+    for (; x + 4 <= cachedDstWidth; x += 4) {
+        uint32_t left[4], right[4];
+        for (int i = 0; i < 4; i++) {
+            int sx = columnIndex[x + i];
+            memcpy(&left[i], row + sx * 4, 4);
+            memcpy(&right[i], row + std::min(sx + 1, srcWidth - 1) * 4, 4);
+        }
+        __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left));
+        __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right));
+        __m128i w0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(channelWeight.data() + x * 4));
+        __m128i w1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(channelWeight.data() + x * 4 + 8));
+        __m128i out0 = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(l, zero), _mm_sub_epi16(full, w0)),
+            _mm_mullo_epi16(_mm_unpacklo_epi8(r, zero), w0));
+        __m128i out1 = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(l, zero), _mm_sub_epi16(full, w1)),
+            _mm_mullo_epi16(_mm_unpackhi_epi8(r, zero), w1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), out0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4 + 8), out1);
+    }
+#endif
+    for (; x < cachedDstWidth; x++) {
+        const uint8_t* left = row + columnIndex[x] * 4;
+        const uint8_t* right = row + std::min(columnIndex[x] + 1, srcWidth - 1) * 4;
+        int w = columnWeight[x];
+        for (int c = 0; c < 4; c++) {
+            out[x * 4 + c] = static_cast<uint16_t>(left[c] * (256 - w) + right[c] * w);
+        }
+    }
+}
+
+void BilinearUpscaler::BlendRows(const uint16_t* top, const uint16_t* bottom, int w, uint8_t* dst, int count) {
+    int i = 0;
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+    // The inputs use all 16 bits, so the products are formed at 32 bits from their low
+    // and high halves
+    const __m128i topWeight = _mm_set1_epi16(static_cast<short>(256 - w));
+    const __m128i bottomWeight = _mm_set1_epi16(static_cast<short>(w));
+    const __m128i round = _mm_set1_epi32(1 << 15);
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i));
+        __m128i aLow = _mm_mullo_epi16(a, topWeight), aHigh = _mm_mulhi_epu16(a, topWeight);
+        __m128i bLow = _mm_mullo_epi16(b, bottomWeight), bHigh = _mm_mulhi_epu16(b, bottomWeight);
+        __m128i sum0 = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(aLow, aHigh), _mm_unpacklo_epi16(bLow, bHigh)), round);
+        __m128i sum1 = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(aLow, aHigh), _mm_unpackhi_epi16(bLow, bHigh)), round);
+        __m128i words = _mm_packs_epi32(_mm_srli_epi32(sum0, 16), _mm_srli_epi32(sum1, 16));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(words, _mm_setzero_si128()));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = static_cast<uint8_t>((top[i] * (256 - w) + bottom[i] * w + (1 << 15)) >> 16);
+    }
+}
+
+// Generator state layout: "T3DGEN1\0", width, height, history length (uint32), analysis
+// frame counter (uint64), then the depth map and each history map oldest last, as
+// height rows of width floats. An empty depth map has a zero size.
+static const char GENERATOR_STATE_MAGIC[8] = "T3DGEN1";
+
+static void WriteDepthRows(std::ostream& out, const std::vector<std::vector<float>>& map) {
+    for (const auto& row : map) out.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+}
+
+static bool ReadDepthRows(std::istream& in, std::vector<std::vector<float>>& map, uint32_t width, uint32_t height) {
+    map.assign(height, std::vector<float>(width));
+    for (auto& row : map) in.read(reinterpret_cast<char*>(row.data()), row.size() * sizeof(float));
+    return in.good();
+}
+
+bool AdvancedDepthGenerator::SaveState(std::ostream& out) const {
+    uint32_t height = static_cast<uint32_t>(depthMap.size());
+    uint32_t width = height ? static_cast<uint32_t>(depthMap[0].size()) : 0;
+    uint32_t historyCount = static_cast<uint32_t>(depthHistory.size());
+    uint64_t frame = analysisFrame;
+
+    out.write(GENERATOR_STATE_MAGIC, sizeof(GENERATOR_STATE_MAGIC));
+    out.write(reinterpret_cast<const char*>(&width), sizeof(width));
+    out.write(reinterpret_cast<const char*>(&height), sizeof(height));
+    out.write(reinterpret_cast<const char*>(&historyCount), sizeof(historyCount));
+    out.write(reinterpret_cast<const char*>(&frame), sizeof(frame));
+    WriteDepthRows(out, depthMap);
+    for (const auto& map : depthHistory) WriteDepthRows(out, map);
+    return out.good();
+}
+
+bool AdvancedDepthGenerator::LoadState(std::istream& in, int expectedWidth, int expectedHeight) {
+    char magic[8] = {};
+    uint32_t width = 0, height = 0, historyCount = 0;
+    uint64_t frame = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&width), sizeof(width));
+    in.read(reinterpret_cast<char*>(&height), sizeof(height));
+    in.read(reinterpret_cast<char*>(&historyCount), sizeof(historyCount));
+    in.read(reinterpret_cast<char*>(&frame), sizeof(frame));
+    if (!in.good() || memcmp(magic, GENERATOR_STATE_MAGIC, sizeof(magic)) != 0) return false;
+
+    // Sizes come from the file, so they are checked before they size any allocation. A
+    // generator that has not analysed anything yet saves an empty state.
+    bool empty = width == 0 && height == 0 && historyCount == 0;
+    if (!empty && (width != static_cast<uint32_t>(expectedWidth) || height != static_cast<uint32_t>(expectedHeight) ||
+        historyCount > static_cast<uint32_t>(DepthWindowAccumulator::MAX_MAPS))) {
+        return false;
+    }
+
+    // A truncated file fails here rather than after allocating every map
+    std::streampos start = in.tellg();
+    if (start != std::streampos(-1)) {
+        in.seekg(0, std::ios::end);
+        std::streampos end = in.tellg();
+        in.seekg(start);
+        uint64_t needed = (1ull + historyCount) * width * height * sizeof(float);
+        if (!in.good() || end == std::streampos(-1) || static_cast<uint64_t>(end - start) < needed) return false;
+    }
+
+    std::vector<std::vector<float>> map;
+    std::deque<std::vector<std::vector<float>>> history;
+    if (!ReadDepthRows(in, map, width, height)) return false;
+    for (uint32_t i = 0; i < historyCount; i++) {
+        history.emplace_back();
+        if (!ReadDepthRows(in, history.back(), width, height)) return false;
+    }
+
+    depthMap = std::move(map);
+    depthHistory = std::move(history);
+    analysisFrame = frame;
+    historyWeights.clear();
+    historyWeightTotal = 1.0f;
+    return true;
+}
+
+// Function to save configuration to file
+bool SaveConfigToFile(const std::string& filename, const DepthIllusionConfig& config) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    file.write(reinterpret_cast<const char*>(&config), sizeof(DepthIllusionConfig));
+    return file.good();
+}
+
+// Function to load configuration from file
+bool LoadConfigFromFile(const std::string& filename, DepthIllusionConfig& config) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    file.read(reinterpret_cast<char*>(&config), sizeof(DepthIllusionConfig));
+    return file.good();
+}
+
+// Function to create a preset with predefined settings
+DepthIllusionConfig CreatePreset(int presetId, const DepthIllusionConfig& base) {
+    DepthIllusionConfig preset = base; // Start with the given settings
+
+    switch (presetId) {
+    case 1: // Subtle effect
+        preset.depth_intensity = 20.0f;
+        preset.edge_boost = 3.0f;
+        preset.base_shift = 5.0f;
+        preset.perspective_strength = 1.0f;
+        preset.phase_speed = 0.08f;
+        preset.alpha = 150;
+        preset.color_intensity = 0.6f;
+        preset.wave_amplitude = 0.5f;
+        preset.iridescence_intensity = 0.3f;
+        break;
+
+    case 2: // Intense effect
+        preset.depth_intensity = 60.0f;
+        preset.edge_boost = 8.0f;
+        preset.base_shift = 15.0f;
+        preset.perspective_strength = 2.0f;
+        preset.phase_speed = 0.25f;
+        preset.alpha = 200;
+        preset.color_intensity = 1.8f;
+        preset.wave_amplitude = 1.8f;
+        preset.iridescence_intensity = 0.9f;
+        break;
+
+    case 3: // Psychedelic effect
+        preset.depth_intensity = 70.0f;
+        preset.edge_boost = 10.0f;
+        preset.base_shift = 20.0f;
+        preset.perspective_strength = 2.5f;
+        preset.phase_speed = 0.35f;
+        preset.alpha = 220;
+        preset.color_intensity = 2.5f;
+        preset.wave_amplitude = 2.5f;
+        preset.iridescence_intensity = 1.0f;
+        preset.hue_range = 2.0f;
+        preset.iridescence_speed = 0.25f;
+        break;
+
+    case 4: // Focus effect
+        preset.depth_intensity = 50.0f;
+        preset.edge_boost = 5.0f;
+        preset.base_shift = 12.0f;
+        preset.perspective_strength = 1.2f;
+        preset.phase_speed = 0.15f;
+        preset.alpha = 180;
+        preset.focus_distance = 0.5f;
+        preset.focus_range = 0.1f;
+        preset.blur_radius = 3.0f;
+        preset.color_intensity = 1.5f;
+        break;
+    }
+
+    return preset;
+}
+
+bool SetConfigField(DepthIllusionConfig& config, const std::string& name, const std::string& value) {
+    using C = DepthIllusionConfig;
+    static const struct { const char* name; float C::* field; } floatFields[] = {
+        { "depth_intensity", &C::depth_intensity }, { "edge_boost", &C::edge_boost },
+        { "base_shift", &C::base_shift }, { "perspective_strength", &C::perspective_strength },
+        { "phase_speed", &C::phase_speed }, { "target_fps", &C::target_fps },
+        { "vertical_shift", &C::vertical_shift }, { "color_intensity", &C::color_intensity },
+        { "blur_radius", &C::blur_radius }, { "luminance_influence", &C::luminance_influence },
+        { "texture_influence", &C::texture_influence }, { "motion_factor", &C::motion_factor },
+        { "focus_distance", &C::focus_distance }, { "focus_range", &C::focus_range },
+        { "wave_amplitude", &C::wave_amplitude }, { "wave_frequency", &C::wave_frequency },
+        { "render_scale", &C::render_scale }, { "fovea_radius", &C::fovea_radius },
+        { "iridescence_intensity", &C::iridescence_intensity }, { "iridescence_speed", &C::iridescence_speed },
+        { "iridescence_scale", &C::iridescence_scale }, { "hue_range", &C::hue_range },
+        { "hue_offset", &C::hue_offset },
+    };
+    static const struct { const char* name; int C::* field; } intFields[] = {
+        { "history_frames", &C::history_frames }, { "idle_max_interval", &C::idle_max_interval },
+        { "edge_kernel_mode", &C::edge_kernel_mode }, { "flat_threshold", &C::flat_threshold },
+        { "fovea_max_step", &C::fovea_max_step }, { "interlace_frames", &C::interlace_frames },
+        { "lookahead_frames", &C::lookahead_frames },
+    };
+    static const struct { const char* name; bool C::* field; } boolFields[] = {
+        { "temporal_smoothing", &C::temporal_smoothing }, { "adaptive_quality", &C::adaptive_quality },
+        { "power_saving", &C::power_saving }, { "foveated", &C::foveated },
+        { "fovea_follow_cursor", &C::fovea_follow_cursor }, { "interlace_checkerboard", &C::interlace_checkerboard },
+        { "enable_iridescence", &C::enable_iridescence },
+    };
+
+    const char* text = value.c_str();
+    char* end = nullptr;
+    for (const auto& entry : floatFields) {
+        if (name != entry.name) continue;
+        float parsed = std::strtof(text, &end);
+        if (end == text || *end != '\0') return false;
+        config.*entry.field = parsed;
+        return true;
+    }
+    for (const auto& entry : intFields) {
+        if (name != entry.name) continue;
+        long parsed = std::strtol(text, &end, 10);
+        if (end == text || *end != '\0') return false;
+        config.*entry.field = static_cast<int>(parsed);
+        return true;
+    }
+    for (const auto& entry : boolFields) {
+        if (name != entry.name) continue;
+        if (value == "1" || value == "true" || value == "on") config.*entry.field = true;
+        else if (value == "0" || value == "false" || value == "off") config.*entry.field = false;
+        else return false;
+        return true;
+    }
+    if (name == "alpha") {
+        long parsed = std::strtol(text, &end, 10);
+        if (end == text || *end != '\0' || parsed < 0 || parsed > 255) return false;
+        config.alpha = static_cast<uint8_t>(parsed);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,1047 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TaskScheduler.h"
+
+// Portable depth illusion core: analysis, blur and compositing of 32-bit BGRA frames.
+// Nothing here depends on Windows or on the screen; every size comes from the caller,
+// so any number of DepthPipeline instances can run side by side.
+
+const int INTERLACE_TILE = 16;  // Tile size for checkerboard interlaced analysis
+const int TILE_SIZE = 64;       // Tile size for the tile task graph
+
+// Advanced configuration with more parameters
+struct DepthIllusionConfig {
+    // Basic settings
+    float depth_intensity = 250.0f;      // Overall depth effect strength
+    float edge_boost = 10.0f;           // Edge detection multiplier
+    float base_shift = 20.0f;          // Base pixel displacement amount
+    float perspective_strength = 4.5f;  // Perspective effect (stronger at screen bottom)
+    float phase_speed = 0.1f;         // Animation speed
+    float target_fps = 60.0f;          // Frame rate the render loop is paced to
+    uint8_t alpha = 245;                  // Global overlay transparency
+
+    // Enhanced settings
+    float vertical_shift = 0.2f;       // Vertical displacement amount
+    float color_intensity = 0.3f;      // Color separation intensity
+    float blur_radius = 2.5f;          // Depth-based blur amount
+    float luminance_influence = 1.4f;  // How much brightness affects depth
+    float texture_influence = 10.6f;    // How much texture detail affects depth
+    float motion_factor = 8.8f;        // Motion detection influence
+    float focus_distance = 0.5f;       // Normalized distance (0-1) for focus plane
+    float focus_range = 0.6f;          // Range around focus distance that appears sharp
+
+    // Dynamic animation
+    float wave_amplitude = 0.1f;       // Amplitude of wave effect
+    float wave_frequency = 0.001f;     // Frequency of wave pattern
+    bool temporal_smoothing = true;    // Enable temporal smoothing
+    int history_frames = 60;           // Number of frames to use for temporal smoothing
+    int lookahead_frames = 0;          // Offline only: average over N past and N future frames instead (0 = causal history)
+
+    // Quality / performance
+    bool adaptive_quality = false;     // Let the governor trade fidelity for frame rate under load (T)
+    bool power_saving = false;         // Capture/analyse less often while the screen is static (P)
+    int idle_max_interval = 8;         // Longest gap between captures of static content, in frames
+    int edge_kernel_mode = 0;          // 0 = 3x3 + 5x5 multi-scale edges, 1 = 3x3 with the 5x5 ring estimated as 1.6x its response (faster, approximate)
+    float render_scale = 1.0f;         // Overlay is composited at this fraction of screen size and upscaled
+    int flat_threshold = 0;            // Tiles whose colour range is within this skip edge detection and blur (0 = exactly flat only, lossless; -1 = off)
+
+    // Foveated processing
+    bool foveated = false;             // Full detail only around the focus point, coarser towards the edges
+    bool fovea_follow_cursor = true;   // Focus on the mouse cursor instead of the screen centre
+    float fovea_radius = 0.35f;        // Full-detail radius as a fraction of screen height; each further ring halves resolution
+    int fovea_max_step = 4;            // Coarsest sampling step in the periphery, in pixels
+
+    // Amortised analysis
+    int interlace_frames = 1;          // Spread analysis over N frames (1 = analyse every pixel each frame)
+    bool interlace_checkerboard = false; // Stagger by checkerboard tiles instead of by rows
+
+    // Iridescent effect settings
+    bool enable_iridescence = true;    // Toggle for iridescent effect
+    float iridescence_intensity = 7.7f;// Strength of iridescent effect
+    float iridescence_speed = 1.02f;   // How quickly colors cycle
+    float iridescence_scale = 0.1f;   // Scale of the iridescent pattern
+    float hue_range = 1.0f;            // Range of hues used (1.0 = full spectrum)
+    float hue_offset = 0.0f;           // Starting hue offset
+};
+
+// Raw copy of the struct, as written by SaveConfigToFile
+bool SaveConfigToFile(const std::string& filename, const DepthIllusionConfig& config);
+bool LoadConfigFromFile(const std::string& filename, DepthIllusionConfig& config);
+
+// Built-in presets 1-4 applied on top of base; other ids return base unchanged
+DepthIllusionConfig CreatePreset(int presetId, const DepthIllusionConfig& base = DepthIllusionConfig());
+
+// Sets the member called name (as spelled in DepthIllusionConfig) from text. Booleans
+// take 1/0, true/false or on/off. Returns false for unknown names or malformed values.
+bool SetConfigField(DepthIllusionConfig& config, const std::string& name, const std::string& value);
+
+struct MaskRect {
+    int left, top, right, bottom;
+};
+
+// Screen areas to leave alone (taskbar, docked panels, video). Applied per tile: a tile is
+// skipped as a whole only when none of its pixels is processed.
+struct RegionMask {
+    struct Region {
+        MaskRect rect; // Screen pixels
+        bool exclude;  // Skip the area (true) or process it (false)
+    };
+
+    std::vector<Region> regions;       // Later regions take precedence over earlier ones
+    bool includeByDefault = true;      // Whether pixels outside every region are processed
+    std::vector<uint8_t> bitmask;         // Optional row-major mask stretched over the screen; 0 = skip
+    int bitmaskWidth = 0;
+    int bitmaskHeight = 0;
+    bool passthrough = false;          // Skipped areas show the captured screen instead of nothing
+
+    bool Processes(int x, int y, int width, int height) const {
+        bool processed = includeByDefault;
+        if (!bitmask.empty() && bitmaskWidth > 0 && bitmaskHeight > 0) {
+            int mx = std::min(bitmaskWidth - 1, x * bitmaskWidth / width);
+            int my = std::min(bitmaskHeight - 1, y * bitmaskHeight / height);
+            processed = processed && bitmask[my * bitmaskWidth + mx] != 0;
+        }
+        for (const Region& region : regions) {
+            if (x >= region.rect.left && x < region.rect.right && y >= region.rect.top && y < region.rect.bottom) {
+                processed = !region.exclude;
+            }
+        }
+        return processed;
+    }
+
+    // Whether any pixel of area is processed. The mask is constant between region edges and
+    // bitmask cell edges, so one pixel of each piece those edges cut area into decides it.
+    bool ProcessesAny(const MaskRect& area, int width, int height) const {
+        for (int y : Cuts(area.top, area.bottom, height, false)) {
+            for (int x : Cuts(area.left, area.right, width, true)) {
+                if (Processes(x, y, width, height)) return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // Starts of the pieces [begin, end) is cut into along one axis
+    std::vector<int> Cuts(int begin, int end, int size, bool horizontal) const {
+        std::vector<int> cuts = { begin };
+        auto add = [&](int edge) { if (edge > begin && edge < end) cuts.push_back(edge); };
+        for (const Region& region : regions) {
+            add(horizontal ? region.rect.left : region.rect.top);
+            add(horizontal ? region.rect.right : region.rect.bottom);
+        }
+        int cells = horizontal ? bitmaskWidth : bitmaskHeight;
+        if (!bitmask.empty() && bitmaskWidth > 0 && bitmaskHeight > 0) {
+            // The first pixel of cell m is ceil(m * size / cells)
+            for (int m = static_cast<int>(static_cast<long long>(begin) * cells / size) + 1; m < cells; m++) {
+                int edge = static_cast<int>((static_cast<long long>(m) * size + cells - 1) / cells);
+                if (edge >= end) break;
+                add(edge);
+            }
+        }
+        std::sort(cuts.begin(), cuts.end());
+        cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+        return cuts;
+    }
+};
+
+template <typename T>
+T clamp(T value, T minVal, T maxVal) {
+    return std::max(minVal, std::min(value, maxVal));
+}
+
+// Convert HSV to RGB
+void HSVtoRGB(float h, float s, float v, float& r, float& g, float& b);
+
+// Apply iridescent effect to a color
+void ApplyIridescence(const DepthIllusionConfig& cfg, int x, int y, float depth, float time, uint8_t& r, uint8_t& g, uint8_t& b);
+
+// Enhanced depth analysis with temporal awareness
+class AdvancedDepthGenerator {
+public:
+    void Analyze(const DepthIllusionConfig& cfg, uint8_t* pixels, int width, int height) {
+        BeginFrame(cfg, width, height);
+        DetectEdges(pixels, 0, 0, width, height);
+        EstimateDepth(0, 0, width, height);
+        SmoothDepth(0, 0, width, height);
+        EndFrame();
+    }
+
+    // Tile-level analysis for the tile task graph. BeginFrame/EndFrame bracket the frame;
+    // in between, each tile runs DetectEdges -> EstimateDepth -> SmoothDepth on its own
+    // rectangle and tiles may proceed concurrently. A step above 1 analyses one pixel per
+    // step x step block and SmoothDepth spreads its depth over the block.
+    void BeginFrame(const DepthIllusionConfig& cfg, int width, int height) {
+        frameConfig = cfg;
+
+        // Interlaced analysis refreshes only a 1/N slice of the screen each frame and carries the
+        // rest over from the previous depth map; temporal smoothing hides the staggering.
+        int interlace = std::max(1, frameConfig.interlace_frames);
+        bool fullRefresh = interlace == 1 || depthMap.size() != static_cast<size_t>(height) ||
+            (height > 0 && depthMap[0].size() != static_cast<size_t>(width));
+        frameInterlace = fullRefresh ? 1 : interlace;
+        frameSlice = static_cast<int>(analysisFrame++ % frameInterlace);
+        frameWidth = width;
+        frameHeight = height;
+        frameSmoothing = frameConfig.temporal_smoothing && !depthHistory.empty();
+        if (frameSmoothing) UpdateHistoryWeights();
+
+        currentDepthMap = fullRefresh ?
+            std::vector<std::vector<float>>(height, std::vector<float>(width, 0.0f)) : depthMap;
+        if (luminanceMap.size() != static_cast<size_t>(height) ||
+            (height > 0 && luminanceMap[0].size() != static_cast<size_t>(width))) {
+            luminanceMap.assign(height, std::vector<float>(width, 0.0f));
+            textureMap.assign(height, std::vector<float>(width, 0.0f));
+        }
+    }
+
+    // A flat rectangle (see IsFlatRegion) has no edges to find, so its texture is zero
+    void DetectEdges(const uint8_t* pixels, int x0, int y0, int x1, int y1, int step = 1, bool flat = false) {
+        // Extract luminance and perform advanced edge detection
+        ForEachAnalysedSpan(x0, y0, x1, y1, step, [&](int y, int spanX0, int spanX1) {
+            for (int x = spanX0; x < spanX1; x += step) {
+                int offset = (y * frameWidth + x) * 4;
+
+                // Calculate luminance
+                float luminance = 0.299f * pixels[offset + 2] + // Red
+                    0.587f * pixels[offset + 1] + // Green
+                    0.114f * pixels[offset];      // Blue
+                luminanceMap[y][x] = luminance / 255.0f;
+            }
+
+            if (flat) {
+                std::fill(textureMap[y].begin() + spanX0, textureMap[y].begin() + spanX1, 0.0f);
+                return;
+            }
+
+            // Multi-scale edge detection
+            for (int x = spanX0; x < spanX1; x += step) {
+                CalculateEdgeStrength(pixels, frameWidth, frameHeight, x, y, textureMap);
+            }
+        });
+    }
+
+    void EstimateDepth(int x0, int y0, int x1, int y1, int step = 1) {
+        const DepthIllusionConfig cfg = frameConfig;
+
+        // Combine multiple cues for depth estimation
+        ForEachAnalysedSpan(x0, y0, x1, y1, step, [&](int y, int spanX0, int spanX1) {
+            for (int x = spanX0; x < spanX1; x += step) {
+                float depthFromTexture = textureMap[y][x] * cfg.texture_influence;
+                float depthFromLuminance = (1.0f - luminanceMap[y][x]) * cfg.luminance_influence;
+
+                // Apply perspective bias (objects lower in frame tend to be closer)
+                float perspectiveBias = (float)y / frameHeight * 0.2f;
+
+                // Focus plane depth adjustment
+                float normalizedDepth = depthFromTexture + depthFromLuminance + perspectiveBias;
+                float focusAdjustment = 1.0f - std::min(
+                    std::abs(normalizedDepth - cfg.focus_distance) / cfg.focus_range,
+                    1.0f
+                );
+
+                // Store final depth value
+                currentDepthMap[y][x] = clamp(normalizedDepth * focusAdjustment * cfg.depth_intensity, 0.0f, 1.0f);
+            }
+        });
+    }
+
+    void SmoothDepth(int x0, int y0, int x1, int y1, int step = 1) {
+        // Temporal smoothing
+        if (frameSmoothing) {
+            ApplyTemporalSmoothing(currentDepthMap, x0, y0, x1, y1, step);
+        }
+
+        if (step > 1) {
+            FillBlocks(currentDepthMap, x0, y0, x1, y1, step);
+        }
+    }
+
+    void EndFrame() {
+        // Add to history
+        depthHistory.push_front(currentDepthMap);
+        if (depthHistory.size() > frameConfig.history_frames) {
+            depthHistory.pop_back();
+        }
+
+        // Update current depth map
+        depthMap = std::move(currentDepthMap);
+    }
+
+    // Depth map being built between BeginFrame and EndFrame
+    const std::vector<std::vector<float>>& PendingDepthMap() const { return currentDepthMap; }
+
+    // Temporal state carried from one frame to the next: the depth history, the last
+    // depth map and the analysis frame counter. A generator that loads it analyses its
+    // next frame exactly as the one that saved it would have. Only valid between frames.
+    // LoadState rejects state of any other frame size than width x height, or with more
+    // history than DepthWindowAccumulator::MAX_MAPS, before allocating anything, and
+    // leaves the generator unchanged whenever it fails.
+    bool SaveState(std::ostream& out) const;
+    bool LoadState(std::istream& in, int width, int height);
+
+    std::vector<std::vector<float>> depthMap;
+
+private:
+    // Visits the [x0, x1) spans of each row inside the rectangle that belong to this frame's
+    // interlace slice, skipping the 2 pixel border the edge kernels cannot cover. With a
+    // step above 1 only every step-th row is visited and callers advance x by step; the
+    // sampled pixel is the top-left corner of its block.
+    template <typename Fn>
+    void ForEachAnalysedSpan(int x0, int y0, int x1, int y1, int step, Fn fn) const {
+        x0 = std::max(x0, 2);
+        y0 = std::max(y0, 2);
+        x1 = std::min(x1, frameWidth - 2);
+        y1 = std::min(y1, frameHeight - 2);
+
+        for (int y = y0; y < y1; y += step) {
+            if (!frameConfig.interlace_checkerboard) {
+                if ((y / step) % frameInterlace == frameSlice && x0 < x1) fn(y, x0, x1);
+                continue;
+            }
+
+            int tileY = y / INTERLACE_TILE;
+            for (int tileX = x0 / INTERLACE_TILE; tileX * INTERLACE_TILE < x1; tileX++) {
+                if ((tileX + tileY) % frameInterlace != frameSlice) continue;
+                int spanX0 = std::max(x0, tileX * INTERLACE_TILE);
+                int spanX1 = std::min(x1, (tileX + 1) * INTERLACE_TILE);
+                if (spanX0 < spanX1) fn(y, spanX0, spanX1);
+            }
+        }
+    }
+
+    void CalculateEdgeStrength(const uint8_t* pixels, int width, int height, int x, int y,
+        std::vector<std::vector<float>>& textureMap) {
+        int offset = (y * width + x) * 4;
+        float edge = 0;
+
+        // Multi-kernel edge detection
+        // 3x3 kernel (fine details)
+        float edge1 = 0;
+        for (int i = -1; i <= 1; i++) {
+            for (int j = -1; j <= 1; j++) {
+                if (i == 0 && j == 0) continue;
+                if (x + i >= 0 && x + i < width && y + j >= 0 && y + j < height) {
+                    int neighbor = ((y + j) * width + (x + i)) * 4;
+                    edge1 += abs(pixels[offset + 2] - pixels[neighbor + 2]) * 0.9f; // Red
+                    edge1 += abs(pixels[offset + 1] - pixels[neighbor + 1]) * 1.0f; // Green
+                    edge1 += abs(pixels[offset] - pixels[neighbor]) * 0.8f;         // Blue
+                }
+            }
+        }
+
+        // 5x5 kernel (medium details)
+        float edge2 = 0;
+        if (frameConfig.edge_kernel_mode == 1) {
+            // Fast mode: approximate the outer ring's contribution from the 3x3 response
+            edge2 = edge1 * 1.6f;
+        }
+        else {
+            for (int i = -2; i <= 2; i++) {
+                for (int j = -2; j <= 2; j++) {
+                    if (abs(i) <= 1 && abs(j) <= 1) continue; // Skip the inner 3x3
+                    if (x + i >= 0 && x + i < width && y + j >= 0 && y + j < height) {
+                        int neighbor = ((y + j) * width + (x + i)) * 4;
+                        edge2 += abs(pixels[offset + 2] - pixels[neighbor + 2]) * 0.7f; // Red
+                        edge2 += abs(pixels[offset + 1] - pixels[neighbor + 1]) * 0.9f; // Green
+                        edge2 += abs(pixels[offset] - pixels[neighbor]) * 0.6f;         // Blue
+                    }
+                }
+            }
+        }
+
+        // Combine multi-scale edge information with weighting
+        edge = (edge1 * 0.6f + edge2 * 0.4f) / 3000.0f * frameConfig.edge_boost;
+        textureMap[y][x] = clamp(std::pow(edge, 2.5f), 0.0f, 1.0f);
+    }
+
+    // Copies each sampled pixel over the rest of its step x step block
+    void FillBlocks(std::vector<std::vector<float>>& map, int x0, int y0, int x1, int y1, int step) {
+        int rowEnd = std::min(y1, frameHeight - 2);
+        ForEachAnalysedSpan(x0, y0, x1, y1, step, [&](int y, int spanX0, int spanX1) {
+            for (int x = spanX0; x < spanX1; x += step) {
+                float value = map[y][x];
+                int blockX1 = std::min(x + step, spanX1);
+                for (int by = y; by < std::min(y + step, rowEnd); by++) {
+                    std::fill(map[by].begin() + x, map[by].begin() + blockX1, value);
+                }
+            }
+        });
+    }
+
+    // Weight 1 / (n + 1) for the n-th most recent history frame, plus their total with the
+    // current frame's weight of 1. Depends only on how many frames are blended, so it is
+    // rebuilt when history_frames or the history length changes rather than per pixel.
+    void UpdateHistoryWeights() {
+        size_t count = std::min(depthHistory.size(), static_cast<size_t>(std::max(0, frameConfig.history_frames)));
+        if (count == historyWeights.size()) return;
+
+        historyWeights.resize(count);
+        historyWeightTotal = 1.0f;
+        for (size_t frame = 1; frame <= count; frame++) {
+            historyWeights[frame - 1] = 1.0f / (frame + 1);
+            historyWeightTotal += historyWeights[frame - 1];
+        }
+    }
+
+    void ApplyTemporalSmoothing(std::vector<std::vector<float>>& currentMap, int x0, int y0, int x1, int y1, int step) {
+        ForEachAnalysedSpan(x0, y0, x1, y1, step, [&](int y, int spanX0, int spanX1) {
+            for (int x = spanX0; x < spanX1; x += step) {
+                float sum = currentMap[y][x];
+
+                // Blend with history
+                auto pastFrame = depthHistory.begin();
+                for (float frameWeight : historyWeights) {
+                    sum += (*pastFrame++)[y][x] * frameWeight;
+                }
+
+                currentMap[y][x] = sum / historyWeightTotal;
+            }
+        });
+    }
+
+    std::deque<std::vector<std::vector<float>>> depthHistory;
+    std::vector<float> historyWeights;
+    float historyWeightTotal = 1.0f;
+    std::vector<std::vector<float>> currentDepthMap;
+    std::vector<std::vector<float>> luminanceMap;
+    std::vector<std::vector<float>> textureMap;
+    unsigned long long analysisFrame = 0;
+    int frameWidth = 0;
+    int frameHeight = 0;
+    int frameInterlace = 1;
+    int frameSlice = 0;
+    bool frameSmoothing = false;
+    DepthIllusionConfig frameConfig;   // Snapshot the current frame is analysed with
+};
+
+// Symmetric temporal smoothing for offline rendering, where future frames are known: the
+// depth of a frame is the plain average of the depth maps in a window around it. Maps
+// enter at the new end of the window and leave at the old end, and the window keeps a
+// running sum, so each frame costs one add, one subtract and one divide per pixel
+// whatever the window size. Depths are summed in fixed point, which makes the sum
+// independent of the order maps came and went: two renders that reach the same window
+// any way agree bit for bit. Row-range methods let callers split the work.
+class DepthWindowAccumulator {
+public:
+    static const int FRACTION_BITS = 22;  // Leaves room for windows of up to 1023 maps
+    static const int MAX_MAPS = (1 << (32 - FRACTION_BITS)) - 1;
+
+    void Reset(int width, int height);
+
+    // Makes room for a new map at the new end; fill it with AddRows
+    void PushNewest();
+    // Quantises rows [y0, y1) of depthMap into the newest map and adds them to the sum
+    void AddRows(const std::vector<std::vector<float>>& depthMap, int y0, int y1);
+
+    // Subtracts rows [y0, y1) of the oldest map; PopOldest then drops it
+    void RemoveOldestRows(int y0, int y1);
+    void PopOldest();
+
+    // Writes rows [y0, y1) of the window's average depth
+    void AverageRows(std::vector<std::vector<float>>& depthMap, int y0, int y1) const;
+
+    size_t Count() const { return maps.size(); }
+
+private:
+    int width = 0;
+    int height = 0;
+    std::deque<std::vector<uint32_t>> maps;   // Oldest first
+    std::vector<std::vector<uint32_t>> spare; // Dropped maps, reused by PushNewest
+    std::vector<uint32_t> sum;
+};
+
+// True if every colour channel varies by at most threshold over the [x0, x1) x [y0, y1)
+// rectangle grown by margin pixels. Edge detection and blur of a flat rectangle can be
+// skipped: the kernels reach at most 3 pixels out and would only average equal colours.
+bool IsFlatRegion(const uint8_t* pixels, int width, int height, int x0, int y0, int x1, int y1,
+    int margin, int threshold);
+
+// flat_threshold of the fast mode the quality governor switches to
+const int FAST_FLAT_THRESHOLD = 2;
+
+void CopyTile(const uint8_t* src, uint8_t* dst, int width, int x0, int y0, int x1, int y1);
+
+// Apply a simple Gaussian blur based on depth to the [x0, x1) x [y0, y1) rectangle,
+// reading from src and writing every pixel of the rectangle to dst. A step above 1 blurs
+// one pixel per step x step block and fills the block with it.
+void ApplyDepthBlurTile(const DepthIllusionConfig& cfg, const uint8_t* src, uint8_t* dst, int width, int height,
+    const std::vector<std::vector<float>>& depthMap, int x0, int y0, int x1, int y1, int step = 1);
+
+// Apply a simple Gaussian blur based on depth
+void ApplyDepthBlur(const DepthIllusionConfig& cfg, uint8_t* pixels, int width, int height,
+    const std::vector<std::vector<float>>& depthMap);
+
+// Composites the [lx0, lx1) x [ly0, ly1) rectangle of a dstWidth pixels wide overlay from
+// the blurred width x height frame src. Overlay pixel (lx, ly) samples frame position
+// (sampleX[lx], sampleY[ly]); a step above 1 composites one pixel per step x step block.
+using CompositeTileFn = void (*)(const DepthIllusionConfig& cfg, const uint8_t* src, int width, int height,
+    uint8_t* dst, int dstWidth, const std::vector<std::vector<float>>& depthMap, float phase,
+    const int* sampleX, const int* sampleY, int lx0, int ly0, int lx1, int ly1, int step);
+
+// Picks the pre-instantiated kernel for the effects the config actually uses. Stages whose
+// coefficients are zero are dropped; the output is identical to running them.
+CompositeTileFn SelectCompositeKernel(const DepthIllusionConfig& cfg);
+
+// Composites the [x0, x1) x [y0, y1) rectangle of a full-resolution overlay
+void CompositeDepthTile(const DepthIllusionConfig& cfg, const uint8_t* src, uint8_t* dst, int width, int height,
+    const std::vector<std::vector<float>>& depthMap, float phase, int x0, int y0, int x1, int y1);
+
+// Furthest a composited pixel can read from its own position, in pixels (x, y)
+void CompositeHalo(const DepthIllusionConfig& cfg, int& haloX, int& haloY);
+
+enum RenderStage { STAGE_EDGES, STAGE_DEPTH, STAGE_SMOOTHING, STAGE_BLUR, STAGE_COMPOSITE, STAGE_COUNT };
+
+// True if a and b agree on every listed config member
+inline bool SameFields(const DepthIllusionConfig&, const DepthIllusionConfig&) { return true; }
+
+template <typename Field, typename... Rest>
+bool SameFields(const DepthIllusionConfig& a, const DepthIllusionConfig& b, Field DepthIllusionConfig::* field, Rest... rest) {
+    return a.*field == b.*field && SameFields(a, b, rest...);
+}
+
+// The config fields each render stage reads. A stage's output can be reused while its own
+// inputs and those of every stage before it are unchanged.
+bool StageInputsEqual(RenderStage stage, const DepthIllusionConfig& a, const DepthIllusionConfig& b);
+
+// Per-stage config versions: a stage's version is bumped whenever an observed config
+// differs from the previous one in a field that stage reads
+class StageVersions {
+public:
+    void Observe(const DepthIllusionConfig& cfg) {
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            if (!observed || !StageInputsEqual(static_cast<RenderStage>(stage), last, cfg)) versions[stage]++;
+        }
+        last = cfg;
+        observed = true;
+    }
+
+    unsigned long long Version(int stage) const { return versions[stage]; }
+
+private:
+    DepthIllusionConfig last;
+    bool observed = false;
+    unsigned long long versions[STAGE_COUNT] = {};
+};
+
+// Runs a frame as a tile-granular task graph on a work-stealing pool. Each tile's
+// edge -> depth -> smoothing -> blur chain only depends on itself; its composite task
+// additionally waits for the blur of every tile inside the displacement halo. The top
+// of the screen can therefore be composited while the bottom is still being analysed.
+// In foveated mode every tile is processed at a sampling step that grows with its
+// distance from the focus point, and tiles outside the region mask skip straight to
+// a copy; the graph itself does not change.
+class TileRenderer {
+public:
+    TileRenderer(AdvancedDepthGenerator& depthGen, unsigned threadCount)
+        : depthGen(depthGen), pool(threadCount) {}
+
+    // Renders one frame with a snapshot copied once by the caller; the tasks only
+    // ever read this frame-local copy
+    // output receives OutputWidth() x OutputHeight() pixels, which is the screen size
+    // reduced by render_scale
+    void Render(const DepthIllusionConfig& cfg, const uint8_t* source, uint8_t* output, int width, int height) {
+        int outputWidth, outputHeight, haloTilesX, haloTilesY;
+        GraphShape(cfg, width, height, outputWidth, outputHeight, haloTilesX, haloTilesY);
+        if (width != graphWidth || height != graphHeight || outputWidth != graphOutputWidth ||
+            outputHeight != graphOutputHeight || haloTilesX != graphHaloX || haloTilesY != graphHaloY) {
+            BuildGraph(width, height, outputWidth, outputHeight, (width + TILE_SIZE - 1) / TILE_SIZE,
+                (height + TILE_SIZE - 1) / TILE_SIZE, haloTilesX, haloTilesY);
+        }
+        stageVersions.Observe(cfg);
+
+        ComputeTileSteps(cfg, tileSteps);
+        ApplyRegionMask();
+        frameConfig = &cfg;
+        frameKernel = SelectCompositeKernel(cfg);
+        frameSource = source;
+        frameOutput = output;
+        frameDepth = &depthGen.PendingDepthMap();
+
+        for (auto& time : stageNanoseconds) time = 0;
+        flatTiles = 0;
+
+        depthGen.BeginFrame(cfg, width, height);
+        pool.Run(graph);
+        depthGen.EndFrame();
+
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            stageMilliseconds[stage] = stageNanoseconds[stage].load() / 1e6f;
+            renderedVersions[stage] = stageVersions.Version(stage);
+        }
+
+        // Animation phase is pipeline state, not shared configuration
+        phase += cfg.phase_speed;
+    }
+
+    // Re-runs as little as possible of the last rendered frame for unchanged screen content:
+    // only the composite stage when just composite settings (or the animation) moved on,
+    // blur and composite when blur settings changed too. Blurring needs the frame's source
+    // pixels; pass null if they were not captured. Fails if any analysis setting changed,
+    // or the focus has moved far enough to change any tile's detail level.
+    bool Recomposite(const DepthIllusionConfig& cfg, uint8_t* output, const uint8_t* source = nullptr) {
+        if (recompositeGraph.Size() == 0 || depthGen.depthMap.size() != static_cast<size_t>(graphHeight)) {
+            return false;
+        }
+        int outputWidth, outputHeight, haloTilesX, haloTilesY;
+        GraphShape(cfg, graphWidth, graphHeight, outputWidth, outputHeight, haloTilesX, haloTilesY);
+        if (outputWidth != graphOutputWidth || outputHeight != graphOutputHeight ||
+            haloTilesX != graphHaloX || haloTilesY != graphHaloY) {
+            return false;
+        }
+        ComputeTileSteps(cfg, pendingSteps);
+        if (pendingSteps != tileSteps || regionMask != appliedMask) return false;
+
+        stageVersions.Observe(cfg);
+        int firstStale = STAGE_COMPOSITE;
+        for (int stage = STAGE_BLUR; stage >= 0; stage--) {
+            if (stageVersions.Version(stage) != renderedVersions[stage]) firstStale = stage;
+        }
+        if (firstStale < STAGE_BLUR || (firstStale == STAGE_BLUR && !source)) return false;
+
+        frameConfig = &cfg;
+        frameKernel = SelectCompositeKernel(cfg);
+        frameSource = source;
+        frameOutput = output;
+        frameDepth = &depthGen.depthMap;
+        pool.Run(firstStale == STAGE_BLUR ? reblurGraph : recompositeGraph);
+        renderedVersions[STAGE_BLUR] = stageVersions.Version(STAGE_BLUR);
+
+        phase += cfg.phase_speed;
+        return true;
+    }
+
+    // Accounts for frames that were skipped entirely, keeping the animation on time
+    void AdvancePhase(float delta) { phase += delta; }
+
+    // Focus point for foveated processing, in screen pixels
+    void SetFocusPoint(int x, int y) {
+        focusX = x;
+        focusY = y;
+    }
+
+    // Takes effect with the next Render; null processes the whole screen
+    void SetRegionMask(std::shared_ptr<const RegionMask> mask) { regionMask = std::move(mask); }
+
+    int OutputWidth() const { return graphOutputWidth; }
+    int OutputHeight() const { return graphOutputHeight; }
+
+    // CPU time spent in each stage during the last frame, summed over all workers
+    float StageMilliseconds(int stage) const { return stageMilliseconds[stage]; }
+
+    // Tiles of the last frame that skipped edge detection and blur
+    int FlatTiles() const { return flatTiles.load(); }
+
+private:
+    // Output size and composite halo (in tiles) the graph needs for this config
+    static void GraphShape(const DepthIllusionConfig& cfg, int width, int height,
+        int& outputWidth, int& outputHeight, int& haloTilesX, int& haloTilesY) {
+        int haloX, haloY;
+        CompositeHalo(cfg, haloX, haloY);
+        haloTilesX = (haloX + TILE_SIZE - 1) / TILE_SIZE;
+        haloTilesY = (haloY + TILE_SIZE - 1) / TILE_SIZE;
+        float scale = clamp(cfg.render_scale, 0.1f, 1.0f);
+        outputWidth = std::max(1, static_cast<int>(width * scale + 0.5f));
+        outputHeight = std::max(1, static_cast<int>(height * scale + 0.5f));
+    }
+
+    template <typename Fn>
+    TaskGraph::TaskFn Timed(RenderStage stage, Fn fn) {
+        return [this, stage, fn] {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            stageNanoseconds[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        };
+    }
+
+    // Sampling step of every tile: 1 inside the fovea, doubling with each further ring of
+    // fovea_radius, up to fovea_max_step. Distance is measured to the nearest point of the
+    // tile, so a tile the fovea touches keeps full detail.
+    void ComputeTileSteps(const DepthIllusionConfig& cfg, std::vector<int>& steps) const {
+        steps.assign(static_cast<size_t>(graphTilesX) * graphTilesY, 1);
+        if (!cfg.foveated) return;
+
+        float radius = std::max(1.0f, cfg.fovea_radius * graphHeight);
+        int maxStep = clamp(cfg.fovea_max_step, 1, TILE_SIZE);
+        for (int tileY = 0; tileY < graphTilesY; tileY++) {
+            for (int tileX = 0; tileX < graphTilesX; tileX++) {
+                int x0 = tileX * TILE_SIZE, y0 = tileY * TILE_SIZE;
+                float dx = static_cast<float>(std::max({ x0 - focusX, focusX - (x0 + TILE_SIZE), 0 }));
+                float dy = static_cast<float>(std::max({ y0 - focusY, focusY - (y0 + TILE_SIZE), 0 }));
+                int ring = std::min(static_cast<int>(std::sqrt(dx * dx + dy * dy) / radius), 6);
+                steps[tileY * graphTilesX + tileX] = std::min(1 << ring, maxStep);
+            }
+        }
+    }
+
+    // Re-evaluates the per-tile mask when the mask or the tile grid has changed. Only
+    // overwrites tileMasked in place, so changing the mask never reallocates.
+    void ApplyRegionMask() {
+        if (regionMask == appliedMask && !maskStale) return;
+
+        for (int tileY = 0; tileY < graphTilesY; tileY++) {
+            for (int tileX = 0; tileX < graphTilesX; tileX++) {
+                MaskRect tile = { tileX * TILE_SIZE, tileY * TILE_SIZE,
+                    std::min(graphWidth, (tileX + 1) * TILE_SIZE), std::min(graphHeight, (tileY + 1) * TILE_SIZE) };
+                tileMasked[tileY * graphTilesX + tileX] =
+                    regionMask && !regionMask->ProcessesAny(tile, graphWidth, graphHeight);
+            }
+        }
+        appliedMask = regionMask;
+        maskPassthrough = regionMask && regionMask->passthrough;
+        maskStale = false;
+    }
+
+    // Overlay pixels of a masked tile: transparent, or the captured screen at full opacity
+    void FillMaskedTile(int outputWidth, int lx0, int ly0, int lx1, int ly1) {
+        for (int ly = ly0; ly < ly1; ly++) {
+            uint8_t* out = frameOutput + (ly * outputWidth + lx0) * 4;
+            if (!maskPassthrough) {
+                memset(out, 0, (lx1 - lx0) * 4);
+                continue;
+            }
+
+            // Masked tiles' blur output is a plain copy of the capture
+            const uint8_t* row = blurred.data() + sampleY[ly] * graphWidth * 4;
+            for (int lx = lx0; lx < lx1; lx++, out += 4) {
+                memcpy(out, row + sampleX[lx] * 4, 3);
+                out[3] = 255;
+            }
+        }
+    }
+
+    void BuildGraph(int width, int height, int outputWidth, int outputHeight,
+        int tilesX, int tilesY, int haloTilesX, int haloTilesY) {
+        graph.Clear();
+        recompositeGraph.Clear();
+        reblurGraph.Clear();
+        blurred.assign(static_cast<size_t>(width) * height * 4, 0);
+        tileFlat.assign(static_cast<size_t>(tilesX) * tilesY, 0);
+        tileMasked.assign(static_cast<size_t>(tilesX) * tilesY, 0);
+        maskStale = true;
+
+        // Each reduced-resolution pixel samples the screen pixel under its centre and is
+        // composited by the task of the tile that screen pixel falls in
+        sampleX.resize(outputWidth);
+        sampleY.resize(outputHeight);
+        for (int lx = 0; lx < outputWidth; lx++) {
+            sampleX[lx] = std::min(width - 1, static_cast<int>((lx + 0.5f) * width / outputWidth));
+        }
+        for (int ly = 0; ly < outputHeight; ly++) {
+            sampleY[ly] = std::min(height - 1, static_cast<int>((ly + 0.5f) * height / outputHeight));
+        }
+        std::vector<int> columnStart(tilesX + 1, outputWidth), rowStart(tilesY + 1, outputHeight);
+        for (int lx = outputWidth - 1; lx >= 0; lx--) columnStart[sampleX[lx] / TILE_SIZE] = lx;
+        for (int ly = outputHeight - 1; ly >= 0; ly--) rowStart[sampleY[ly] / TILE_SIZE] = ly;
+        for (int tile = tilesX - 1; tile >= 0; tile--) columnStart[tile] = std::min(columnStart[tile], columnStart[tile + 1]);
+        for (int tile = tilesY - 1; tile >= 0; tile--) rowStart[tile] = std::min(rowStart[tile], rowStart[tile + 1]);
+        std::vector<int> blurTasks(tilesX * tilesY);
+        std::vector<int> compositeTasks(tilesX * tilesY);
+        std::vector<int> reblurTasks(tilesX * tilesY);
+        std::vector<int> recompositeTasks(tilesX * tilesY);
+
+        for (int tileY = 0; tileY < tilesY; tileY++) {
+            for (int tileX = 0; tileX < tilesX; tileX++) {
+                int x0 = tileX * TILE_SIZE, x1 = std::min(width, x0 + TILE_SIZE);
+                int y0 = tileY * TILE_SIZE, y1 = std::min(height, y0 + TILE_SIZE);
+                int tile = tileY * tilesX + tileX;
+
+                int edges = graph.AddTask(Timed(STAGE_EDGES, [=] {
+                    if (tileMasked[tile]) return;
+                    tileFlat[tile] = IsFlatRegion(frameSource, width, height, x0, y0, x1, y1, 3,
+                        frameConfig->flat_threshold);
+                    if (tileFlat[tile]) flatTiles++;
+                    depthGen.DetectEdges(frameSource, x0, y0, x1, y1, tileSteps[tile], tileFlat[tile] != 0);
+                }));
+                int depth = graph.AddTask(Timed(STAGE_DEPTH, [=] {
+                    if (!tileMasked[tile]) depthGen.EstimateDepth(x0, y0, x1, y1, tileSteps[tile]);
+                }));
+                int smooth = graph.AddTask(Timed(STAGE_SMOOTHING, [=] {
+                    if (!tileMasked[tile]) depthGen.SmoothDepth(x0, y0, x1, y1, tileSteps[tile]);
+                }));
+                auto blur = [=] {
+                    if (tileFlat[tile] || tileMasked[tile]) {
+                        CopyTile(frameSource, blurred.data(), width, x0, y0, x1, y1);
+                        return;
+                    }
+                    ApplyDepthBlurTile(*frameConfig, frameSource, blurred.data(), width, height,
+                        *frameDepth, x0, y0, x1, y1, tileSteps[tile]);
+                };
+                blurTasks[tile] = graph.AddTask(Timed(STAGE_BLUR, blur));
+                reblurTasks[tile] = reblurGraph.AddTask(Timed(STAGE_BLUR, blur));
+                int lx0 = columnStart[tileX], lx1 = columnStart[tileX + 1];
+                int ly0 = rowStart[tileY], ly1 = rowStart[tileY + 1];
+                auto composite = [=] {
+                    if (tileMasked[tile]) {
+                        FillMaskedTile(outputWidth, lx0, ly0, lx1, ly1);
+                        return;
+                    }
+                    frameKernel(*frameConfig, blurred.data(), width, height, frameOutput, outputWidth, *frameDepth,
+                        phase, sampleX.data(), sampleY.data(), lx0, ly0, lx1, ly1, tileSteps[tile]);
+                };
+                compositeTasks[tile] = graph.AddTask(Timed(STAGE_COMPOSITE, composite));
+                recompositeTasks[tile] = reblurGraph.AddTask(Timed(STAGE_COMPOSITE, composite));
+                recompositeGraph.AddTask(Timed(STAGE_COMPOSITE, composite));
+
+                graph.AddDependency(edges, depth);
+                graph.AddDependency(depth, smooth);
+                graph.AddDependency(smooth, blurTasks[tile]);
+            }
+        }
+
+        for (int tileY = 0; tileY < tilesY; tileY++) {
+            for (int tileX = 0; tileX < tilesX; tileX++) {
+                for (int ny = std::max(0, tileY - haloTilesY); ny <= std::min(tilesY - 1, tileY + haloTilesY); ny++) {
+                    for (int nx = std::max(0, tileX - haloTilesX); nx <= std::min(tilesX - 1, tileX + haloTilesX); nx++) {
+                        graph.AddDependency(blurTasks[ny * tilesX + nx], compositeTasks[tileY * tilesX + tileX]);
+                        reblurGraph.AddDependency(reblurTasks[ny * tilesX + nx], recompositeTasks[tileY * tilesX + tileX]);
+                    }
+                }
+            }
+        }
+
+        graphWidth = width;
+        graphHeight = height;
+        graphTilesX = tilesX;
+        graphTilesY = tilesY;
+        graphOutputWidth = outputWidth;
+        graphOutputHeight = outputHeight;
+        graphHaloX = haloTilesX;
+        graphHaloY = haloTilesY;
+    }
+
+    AdvancedDepthGenerator& depthGen;
+    WorkStealingPool pool;
+    TaskGraph graph;
+    TaskGraph recompositeGraph;  // Composite tasks only, no dependencies
+    TaskGraph reblurGraph;       // Blur and composite tasks, reusing the last depth map
+    StageVersions stageVersions;
+    unsigned long long renderedVersions[STAGE_COUNT] = {};  // Stage versions blurred/composited holds
+    std::vector<uint8_t> blurred;
+    std::vector<int> sampleX;  // Screen column sampled by each output column
+    std::vector<int> sampleY;  // Screen row sampled by each output row
+    std::vector<int> tileSteps;     // Sampling step of each tile for the current frame
+    std::vector<int> pendingSteps;  // Scratch for Recomposite
+    std::vector<char> tileFlat;     // Tile classified as flat colour this frame
+    std::vector<char> tileMasked;   // Tile excluded by the region mask
+    std::shared_ptr<const RegionMask> regionMask;
+    std::shared_ptr<const RegionMask> appliedMask;  // Mask tileMasked was computed from
+    bool maskPassthrough = false;
+    bool maskStale = true;
+    std::atomic<int> flatTiles{ 0 };
+    int graphWidth = 0;
+    int graphHeight = 0;
+    int graphTilesX = 0;
+    int graphTilesY = 0;
+    int graphOutputWidth = 0;
+    int graphOutputHeight = 0;
+    int graphHaloX = -1;
+    int graphHaloY = -1;
+    float phase = 0.0f;  // Current animation phase
+    int focusX = 0;
+    int focusY = 0;
+    std::atomic<long long> stageNanoseconds[STAGE_COUNT] = {};
+    float stageMilliseconds[STAGE_COUNT] = {};
+
+    // Per-frame inputs read by the tile tasks
+    const DepthIllusionConfig* frameConfig = nullptr;
+    CompositeTileFn frameKernel = nullptr;
+    const uint8_t* frameSource = nullptr;
+    uint8_t* frameOutput = nullptr;
+    const std::vector<std::vector<float>>* frameDepth = nullptr;
+};
+
+// Steps through a quality ladder to hold the frame budget when the machine is loaded,
+// rather than letting the frame rate collapse. Each tier keeps every reduction of the
+// tiers below it. Stepping down needs the smoothed cost to exceed the budget for a short
+// while; stepping back up needs a large margin for much longer, so it does not oscillate.
+class QualityGovernor {
+public:
+    static const int TIER_COUNT = 7;
+
+    // frameMs: cost of the slowest pipeline stage for the last frame
+    void Update(const DepthIllusionConfig& cfg, float frameMs) {
+        if (!cfg.adaptive_quality) {
+            tier = 0;
+            averageMs = 0.0f;
+            return;
+        }
+
+        float targetMs = 1000.0f / std::max(1.0f, cfg.target_fps);
+        averageMs = averageMs == 0.0f ? frameMs : averageMs * 0.9f + frameMs * 0.1f;
+        framesSinceChange++;
+
+        if (averageMs > targetMs * 0.95f && tier < TIER_COUNT - 1 && framesSinceChange >= 15) {
+            ChangeTier(tier + 1);
+        }
+        else if (averageMs < targetMs * 0.6f && tier > 0 && framesSinceChange >= 120) {
+            ChangeTier(tier - 1);
+        }
+    }
+
+    // Lowers the frame-local config to the current tier; never raises quality above
+    // what the user configured
+    void Apply(DepthIllusionConfig& cfg) const {
+        if (tier >= 1) cfg.interlace_frames = std::max(cfg.interlace_frames, 2); // Analyse half the screen per frame
+        if (tier >= 1) cfg.flat_threshold = std::max(cfg.flat_threshold, FAST_FLAT_THRESHOLD); // Skip near-flat tiles
+        if (tier >= 2) cfg.edge_kernel_mode = 1;                                  // 5x5 ring estimated from 3x3
+        if (tier >= 3) cfg.blur_radius = 0.0f;                                    // No depth blur
+        if (tier >= 4) cfg.enable_iridescence = false;                            // No iridescence
+        if (tier >= 5) cfg.interlace_frames = std::max(cfg.interlace_frames, 4); // Analyse a quarter per frame
+        if (tier >= 6) cfg.render_scale = std::min(cfg.render_scale, 0.5f);       // Composite at half resolution
+    }
+
+    int Tier() const { return tier; }
+
+private:
+    void ChangeTier(int newTier) {
+        tier = newTier;
+        framesSinceChange = 0;
+        averageMs = 0.0f;  // Re-measure at the new tier
+    }
+
+    int tier = 0;
+    int framesSinceChange = 0;
+    float averageMs = 0.0f;
+};
+
+// Fast 64-bit content hash used to detect frames identical to the previous one
+unsigned long long HashFrame(const uint8_t* data, size_t size);
+
+// Bilinear BGRA upscaler for reduced-resolution overlays. The horizontal pass runs once
+// per source row into 16-bit intermediates, four pixels at a time with SSE2; the vertical
+// pass, which touches every output pixel, blends two of those rows eight channels at a
+// time. Both axes' sample tables are cached across frames of the same size.
+class BilinearUpscaler {
+public:
+    void Upscale(const uint8_t* src, int srcWidth, int srcHeight, uint8_t* dst, int dstWidth, int dstHeight) {
+        if (srcWidth != cachedSrcWidth || dstWidth != cachedDstWidth) {
+            BuildAxis(srcWidth, dstWidth, columnIndex, columnWeight);
+            channelWeight.resize(static_cast<size_t>(dstWidth) * 4);
+            for (int x = 0; x < dstWidth; x++) {
+                std::fill_n(channelWeight.begin() + x * 4, 4, columnWeight[x]);
+            }
+            cachedSrcWidth = srcWidth;
+            cachedDstWidth = dstWidth;
+        }
+        if (srcHeight != cachedSrcHeight || dstHeight != cachedDstHeight) {
+            BuildAxis(srcHeight, dstHeight, rowIndex, rowWeight);
+            cachedSrcHeight = srcHeight;
+            cachedDstHeight = dstHeight;
+        }
+        rows[0].resize(static_cast<size_t>(dstWidth) * 4);
+        rows[1].resize(static_cast<size_t>(dstWidth) * 4);
+        rowSource[0] = rowSource[1] = -1;
+
+        for (int y = 0; y < dstHeight; y++) {
+            int sy = rowIndex[y];
+            const uint16_t* top = HorizontalRow(src, srcWidth, sy);
+            const uint16_t* bottom = HorizontalRow(src, srcWidth, std::min(sy + 1, srcHeight - 1));
+            BlendRows(top, bottom, rowWeight[y], dst + static_cast<size_t>(y) * dstWidth * 4, dstWidth * 4);
+        }
+    }
+
+private:
+    // For each destination coordinate: the left/top source sample and the 8-bit weight of
+    // the next one, with pixel centres aligned
+    static void BuildAxis(int srcSize, int dstSize, std::vector<int>& index, std::vector<uint16_t>& weight) {
+        index.resize(dstSize);
+        weight.resize(dstSize);
+        for (int d = 0; d < dstSize; d++) {
+            float position = clamp((d + 0.5f) * srcSize / dstSize - 0.5f, 0.0f, static_cast<float>(srcSize - 1));
+            index[d] = static_cast<int>(position);
+            weight[d] = static_cast<uint16_t>((position - index[d]) * 256.0f + 0.5f);
+        }
+    }
+
+    // Horizontally scaled source row, cached so each source row is only expanded once
+    const uint16_t* HorizontalRow(const uint8_t* src, int srcWidth, int sy) {
+        for (int slot = 0; slot < 2; slot++) {
+            if (rowSource[slot] == sy) return rows[slot].data();
+        }
+
+        int slot = rowSource[0] < rowSource[1] ? 0 : 1;
+        ExpandRow(src + static_cast<size_t>(sy) * srcWidth * 4, srcWidth, rows[slot].data());
+        rowSource[slot] = sy;
+        return rows[slot].data();
+    }
+
+    // out = left * (256 - w) + right * w per channel, keeping 8 fractional bits
+    void ExpandRow(const uint8_t* row, int srcWidth, uint16_t* out) const;
+
+    // dst = (top * (256 - w) + bottom * w) / 65536 per channel, rounded; inputs carry 8
+    // fractional bits
+    static void BlendRows(const uint16_t* top, const uint16_t* bottom, int w, uint8_t* dst, int count);
+
+    std::vector<int> columnIndex;
+    std::vector<uint16_t> columnWeight;
+    std::vector<uint16_t> channelWeight;  // columnWeight repeated for each of a pixel's channels
+    std::vector<int> rowIndex;
+    std::vector<uint16_t> rowWeight;
+    std::vector<uint16_t> rows[2];
+    int rowSource[2] = { -1, -1 };
+    int cachedSrcWidth = 0;
+    int cachedDstWidth = 0;
+    int cachedSrcHeight = 0;
+    int cachedDstHeight = 0;
+};
+
+// One independent depth illusion stream: owns its frame size, the config snapshot of the
+// frame being rendered, the analysis history and every intermediate buffer. Instances
+// share nothing, so several can run concurrently (one per monitor or video stream), each
+// on its own worker pool.
+class DepthPipeline {
+public:
+    DepthPipeline(int width, int height, unsigned threadCount = std::thread::hardware_concurrency())
+        : width(width), height(height), renderer(depthGen, threadCount) {}
+
+    DepthPipeline(const DepthPipeline&) = delete;
+    DepthPipeline& operator=(const DepthPipeline&) = delete;
+
+    // Renders one width x height BGRA frame into output, which receives
+    // OutputWidth() x OutputHeight() pixels
+    void Render(const DepthIllusionConfig& cfg, const uint8_t* source, uint8_t* output) {
+        config = cfg;
+        renderer.Render(config, source, output, width, height);
+    }
+
+    // See TileRenderer::Recomposite
+    bool Recomposite(const DepthIllusionConfig& cfg, uint8_t* output, const uint8_t* source = nullptr) {
+        config = cfg;
+        return renderer.Recomposite(config, output, source);
+    }
+
+    void AdvancePhase(float delta) { renderer.AdvancePhase(delta); }
+    void SetFocusPoint(int x, int y) { renderer.SetFocusPoint(x, y); }
+    void SetRegionMask(std::shared_ptr<const RegionMask> mask) { renderer.SetRegionMask(std::move(mask)); }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int OutputWidth() const { return renderer.OutputWidth(); }
+    int OutputHeight() const { return renderer.OutputHeight(); }
+    float StageMilliseconds(int stage) const { return renderer.StageMilliseconds(stage); }
+    int FlatTiles() const { return renderer.FlatTiles(); }
+
+    // Depth map of the last rendered frame, height rows of width values in [0, 1]
+    const std::vector<std::vector<float>>& DepthMap() const { return depthGen.depthMap; }
+
+private:
+    int width;
+    int height;
+    DepthIllusionConfig config;  // Snapshot the current frame is rendered with
+    AdvancedDepthGenerator depthGen;
+    TileRenderer renderer;
+};
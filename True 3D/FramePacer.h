@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <time.h>
+#endif
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Paces a loop against absolute deadlines on a fixed grid (start + n * period), so
+// timing error never accumulates and any rate (30/60/120/144...) is exact on average.
+// Sleeps in the OS until just before the deadline and spins the last fraction of a
+// millisecond. A deadline that has already passed by a whole period counts as missed
+// and the grid skips forward instead of bursting frames to catch up.
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FramePacer(double targetFps) {
+        SetTargetFps(targetFps);
+        nextDeadline = Clock::now();
+#ifdef _WIN32
+        // High resolution timers need Windows 10 1803+; fall back to a regular one
+        timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!timer) {
+            timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+            spinMargin = std::chrono::microseconds(1500);
+        }
+#endif
+    }
+
+    ~FramePacer() {
+#ifdef _WIN32
+        if (timer) CloseHandle(timer);
+#endif
+    }
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // Changing the rate keeps the current deadline, so the next frame is not delayed
+    void SetTargetFps(double targetFps) {
+        if (targetFps <= 0.0) targetFps = 60.0;
+        if (targetFps == fps) return;
+        fps = targetFps;
+        period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+    }
+
+    // Blocks until the next frame deadline and returns it
+    Clock::time_point WaitForNextFrame() {
+        auto now = Clock::now();
+        if (now >= nextDeadline + period) {
+            missed += (now - nextDeadline) / period;
+            nextDeadline += ((now - nextDeadline) / period) * period;
+        }
+
+        SleepUntil(nextDeadline);
+        auto deadline = nextDeadline;
+        nextDeadline += period;
+        frames++;
+        return deadline;
+    }
+
+    double TargetFps() const { return fps; }
+    Clock::duration Period() const { return period; }
+    unsigned long long MissedDeadlines() const { return missed; }
+    unsigned long long FramesPaced() const { return frames; }
+
+private:
+    void SleepUntil(Clock::time_point deadline) {
+        auto wake = deadline - spinMargin;
+        auto now = Clock::now();
+
+        if (wake > now) {
+#ifdef _WIN32
+            if (timer) {
+                // Relative due time in 100 ns units
+                LARGE_INTEGER due;
+                due.QuadPart = -static_cast<LONGLONG>(std::chrono::duration_cast<std::chrono::nanoseconds>(wake - now).count() / 100);
+                if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+                    WaitForSingleObject(timer, INFINITE);
+                }
+            }
+            else {
+                std::this_thread::sleep_until(wake);
+            }
+#else
+            // steady_clock is CLOCK_MONOTONIC, so its epoch can be used as an absolute time
+            auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(wake.time_since_epoch());
+            timespec ts;
+            ts.tv_sec = static_cast<time_t>(sinceEpoch.count() / 1000000000);
+            ts.tv_nsec = static_cast<long>(sinceEpoch.count() % 1000000000);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+#endif
+        }
+
+        while (Clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+    }
+
+    double fps = 0.0;
+    Clock::duration period{};
+    Clock::time_point nextDeadline;
+    unsigned long long missed = 0;
+    unsigned long long frames = 0;
+#ifdef _WIN32
+    HANDLE timer = NULL;
+    Clock::duration spinMargin = std::chrono::microseconds(300);
+#else
+    Clock::duration spinMargin = std::chrono::microseconds(100);
+#endif
+};
@@ -0,0 +1,553 @@
+// FrameSource.cpp : Synthetic and file-backed frame sources.
+//
+
+#include "FrameSource.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+void CopyFrame(const FrameView& view, uint8_t* dst) {
+    size_t rowBytes = static_cast<size_t>(view.width) * 4;
+    if (view.stride == rowBytes) {
+        memcpy(dst, view.pixels, rowBytes * view.height);
+        return;
+    }
+    for (int y = 0; y < view.height; y++) {
+        memcpy(dst + y * rowBytes, view.pixels + y * view.stride, rowBytes);
+    }
+}
+
+unsigned long long FrameSource::Skip(unsigned long long count) {
+    FrameView view;
+    unsigned long long skipped = 0;
+    while (skipped < count && NextFrame(view)) skipped++;
+    return skipped;
+}
+
+static std::chrono::microseconds FrameTimestamp(unsigned long long index, double fps) {
+    return std::chrono::microseconds(static_cast<long long>(index * 1000000.0 / fps));
+}
+
+// Integer hash for the synthetic scenes; identical results on every compiler
+static uint32_t HashCoords(uint32_t a, uint32_t b, uint32_t c = 0, uint32_t d = 0) {
+    uint32_t h = a * 0x9E3779B1u ^ b * 0x85EBCA77u ^ c * 0xC2B2AE3Du ^ d * 0x27D4EB2Fu;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return h;
+}
+
+// Text layout shared by the Text and Scrolling scenes (page coordinates)
+const int TEXT_MARGIN = 16;
+const int TEXT_LINE_HEIGHT = 20;
+const int TEXT_GLYPH_ADVANCE = 9;
+
+static int TextLineLength(int line) {
+    uint32_t h = HashCoords(static_cast<uint32_t>(line), 1);
+    if (h % 9 == 0) return 0;  // Paragraph break
+    return 10 + static_cast<int>(h % 70);
+}
+
+static void TextPixel(int x, int pageY, uint8_t* bgra) {
+    uint8_t value = 245;
+    int line = pageY / TEXT_LINE_HEIGHT;
+    int row = pageY % TEXT_LINE_HEIGHT - 3;
+    int column = (x - TEXT_MARGIN) / TEXT_GLYPH_ADVANCE;
+    int glyphX = (x - TEXT_MARGIN) % TEXT_GLYPH_ADVANCE;
+
+    if (x >= TEXT_MARGIN && row >= 0 && row < 14 && glyphX < 7 && column < TextLineLength(line)) {
+        // Blocky 4x5 glyphs, a few of them left blank as word gaps
+        uint32_t glyph = HashCoords(static_cast<uint32_t>(line), static_cast<uint32_t>(column), 2);
+        if (glyph % 6 != 0 && (HashCoords(glyph, glyphX / 2, row / 3) & 1)) value = 30;
+    }
+
+    bool heading = HashCoords(static_cast<uint32_t>(line), 3) % 11 == 0;
+    bgra[0] = heading && value < 128 ? 140 : value;
+    bgra[1] = value;
+    bgra[2] = value;
+    bgra[3] = 255;
+}
+
+SyntheticFrameSource::SyntheticFrameSource(SyntheticScene scene, int width, int height, double fps,
+    unsigned long long frameCount, int scrollSpeed)
+    : scene(scene), width(width), height(height), fps(fps > 0.0 ? fps : 60.0),
+    frameCount(frameCount), scrollSpeed(scrollSpeed),
+    pixels(static_cast<size_t>(width) * height * 4) {}
+
+MaskRect SyntheticFrameSource::CaretRect() const {
+    const int line = 2;
+    int x = TEXT_MARGIN + TextLineLength(line) * TEXT_GLYPH_ADVANCE;
+    int y = line * TEXT_LINE_HEIGHT + 3;
+    return { std::min(x, width), std::min(y, height), std::min(x + 2, width), std::min(y + 14, height) };
+}
+
+void SyntheticFrameSource::Pixel(int x, int y, uint8_t* bgra) const {
+    switch (scene) {
+    case SyntheticScene::Gradient:
+        bgra[0] = static_cast<uint8_t>(x * 255 / std::max(1, width - 1));
+        bgra[1] = static_cast<uint8_t>(y * 255 / std::max(1, height - 1));
+        bgra[2] = static_cast<uint8_t>((x + y) * 255 / std::max(1, width + height - 2));
+        bgra[3] = 255;
+        break;
+
+    case SyntheticScene::Photo: {
+        float base = 120.0f + 50.0f * std::sin(x * 0.013f) * std::cos(y * 0.017f) + 30.0f * std::sin((x + y) * 0.007f);
+        int grain = static_cast<int>(HashCoords(x, y, 4) & 15) - 8;
+        bgra[0] = static_cast<uint8_t>(clamp(static_cast<int>(base * 0.8f) + grain, 0, 255));
+        bgra[1] = static_cast<uint8_t>(clamp(static_cast<int>(base) + grain, 0, 255));
+        bgra[2] = static_cast<uint8_t>(clamp(static_cast<int>(base * 1.1f + 20.0f) + grain, 0, 255));
+        bgra[3] = 255;
+        break;
+    }
+
+    case SyntheticScene::Text: {
+        MaskRect caret = CaretRect();
+        if (CaretVisible(index) && x >= caret.left && x < caret.right && y >= caret.top && y < caret.bottom) {
+            bgra[0] = bgra[1] = bgra[2] = 0;
+            bgra[3] = 255;
+        }
+        else {
+            TextPixel(x, y, bgra);
+        }
+        break;
+    }
+
+    case SyntheticScene::Scrolling:
+        TextPixel(x, static_cast<int>((y + index * scrollSpeed) % 1000000), bgra);
+        break;
+
+    case SyntheticScene::Video: {
+        float t = index * 0.05f;
+        bgra[0] = static_cast<uint8_t>(128.0f + 127.0f * std::sin((x + y) * 0.015f + t * 0.7f));
+        bgra[1] = static_cast<uint8_t>(128.0f + 127.0f * std::sin(y * 0.03f - t * 1.3f));
+        bgra[2] = static_cast<uint8_t>(128.0f + 127.0f * std::sin(x * 0.02f + t));
+        bgra[3] = 255;
+        break;
+    }
+    }
+}
+
+void SyntheticFrameSource::RenderRows(int y0, int y1) {
+    for (int y = y0; y < y1; y++) {
+        uint8_t* row = pixels.data() + static_cast<size_t>(y) * width * 4;
+        for (int x = 0; x < width; x++) Pixel(x, y, row + x * 4);
+    }
+}
+
+bool SyntheticFrameSource::NextFrame(FrameView& view) {
+    if (frameCount != 0 && index >= frameCount) return false;
+
+    view.damage.clear();
+    view.fullDamage = index == 0 || scene == SyntheticScene::Scrolling || scene == SyntheticScene::Video;
+    if (view.fullDamage) {
+        RenderRows(0, height);
+    }
+    else if (scene == SyntheticScene::Text && CaretVisible(index) != CaretVisible(index - 1)) {
+        MaskRect caret = CaretRect();
+        for (int y = caret.top; y < caret.bottom; y++) {
+            for (int x = caret.left; x < caret.right; x++) {
+                Pixel(x, y, pixels.data() + (static_cast<size_t>(y) * width + x) * 4);
+            }
+        }
+        view.damage.push_back(caret);
+    }
+
+    view.pixels = pixels.data();
+    view.width = width;
+    view.height = height;
+    view.stride = static_cast<size_t>(width) * 4;
+    view.index = index;
+    view.timestamp = FrameTimestamp(index, fps);
+    index++;
+    return true;
+}
+
+FileFrameSource::~FileFrameSource() {
+    if (file && ownsFile) fclose(file);
+}
+
+bool FileFrameSource::Open(const std::string& path, int rawWidth, int rawHeight, double rawFps) {
+    if (path == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        file = stdin;
+        ownsFile = false;
+    }
+    else {
+        file = fopen(path.c_str(), "rb");
+        ownsFile = true;
+    }
+    if (!file) return false;
+    fps = rawFps > 0.0 ? rawFps : 60.0;
+
+    // Streams cannot be rewound, so the signature bytes are consumed here and the
+    // header readers continue after them
+    int first = getc(file);
+    int second = first == EOF ? EOF : getc(file);
+    if (first == 'P' && (second == '6' || second == '7')) {
+        format = second == '6' ? Format::Ppm : Format::Pam;
+        if (!(format == Format::Ppm ? ReadPpmHeader() : ReadPamHeader())) return false;
+        headerPending = true;
+    }
+    else if (first == 'Y' && second == 'U') {
+        format = Format::Y4m;
+        if (!ReadY4mHeader()) return false;
+    }
+    else {
+        format = Format::Raw;
+        width = rawWidth;
+        height = rawHeight;
+        if (width <= 0 || height <= 0) return false;
+        // The signature bytes are the start of the first frame
+        if (first != EOF) prefix[prefixBytes++] = static_cast<uint8_t>(first);
+        if (second != EOF) prefix[prefixBytes++] = static_cast<uint8_t>(second);
+        return true;
+    }
+
+    return width > 0 && height > 0 && width <= 32768 && height <= 32768;
+}
+
+// Next ASCII number of a PPM header, skipping whitespace and comments. The single
+// whitespace character after the number is consumed with it.
+int FileFrameSource::ReadPpmNumber() {
+    int c = getc(file);
+    while (c == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) c = getc(file);
+        }
+        c = getc(file);
+    }
+
+    int value = -1;
+    while (c >= '0' && c <= '9' && value < (1 << 20)) {
+        value = (value < 0 ? 0 : value * 10) + (c - '0');
+        c = getc(file);
+    }
+    return value;
+}
+
+bool FileFrameSource::SetImageSize(int w, int h, int depth, int maxval) {
+    if (w <= 0 || h <= 0 || w > 32768 || h > 32768 || maxval <= 0 || maxval > 65535) return false;
+    if (depth != 1 && depth != 3 && depth != 4) return false;
+
+    // Every image of a stream must have the size of the first one
+    if (width != 0 && (w != width || h != height)) return false;
+    width = w;
+    height = h;
+    channels = depth;
+    maxValue = maxval;
+    packed.resize(static_cast<size_t>(width) * height * channels * (maxValue > 255 ? 2 : 1));
+    return true;
+}
+
+bool FileFrameSource::ReadPpmHeader() {
+    int w = ReadPpmNumber();
+    int h = ReadPpmNumber();
+    int maxval = ReadPpmNumber();
+    return SetImageSize(w, h, 3, maxval);
+}
+
+// PAM headers are "KEY value" lines up to ENDHDR. Depth 1 is grey, 3 RGB, 4 RGB_ALPHA.
+bool FileFrameSource::ReadPamHeader() {
+    int w = 0, h = 0, depth = 0, maxval = 0;
+    std::string line;
+    for (int c = getc(file); ; c = getc(file)) {
+        if (c == EOF || line.size() > 256) return false;
+        if (c != '\n') {
+            line += static_cast<char>(c);
+            continue;
+        }
+
+        char key[16] = {};
+        int value = 0;
+        if (line == "ENDHDR") break;
+        if (sscanf(line.c_str(), "%15s %d", key, &value) == 2) {
+            if (strcmp(key, "WIDTH") == 0) w = value;
+            else if (strcmp(key, "HEIGHT") == 0) h = value;
+            else if (strcmp(key, "DEPTH") == 0) depth = value;
+            else if (strcmp(key, "MAXVAL") == 0) maxval = value;
+        }
+        line.clear();
+    }
+    return SetImageSize(w, h, depth, maxval);
+}
+
+// Header of the next image, unless Open already read it
+bool FileFrameSource::NextNetpbmHeader() {
+    if (headerPending) {
+        headerPending = false;
+        return true;
+    }
+    int c = getc(file);
+    while (c == ' ' || c == '\t' || c == '\r' || c == '\n') c = getc(file);
+    int magic = c == 'P' ? getc(file) : EOF;
+    if (magic != (format == Format::Ppm ? '6' : '7')) return false;
+    return format == Format::Ppm ? ReadPpmHeader() : ReadPamHeader();
+}
+
+bool FileFrameSource::ReadNetpbmFrame(uint8_t* pixels) {
+    if (!NextNetpbmHeader()) return false;
+
+    if (fread(packed.data(), 1, packed.size(), file) != packed.size()) return false;
+
+    size_t count = static_cast<size_t>(width) * height;
+    if (maxValue == 255 && channels >= 3) {
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t* in = &packed[i * channels];
+            pixels[i * 4 + 0] = in[2];
+            pixels[i * 4 + 1] = in[1];
+            pixels[i * 4 + 2] = in[0];
+            pixels[i * 4 + 3] = channels == 4 ? in[3] : 255;
+        }
+        return true;
+    }
+
+    bool wide = maxValue > 255;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t samples[4] = { 0, 0, 0, 255 };
+        for (int c = 0; c < channels; c++) {
+            size_t at = i * channels + c;
+            int sample = wide ? (packed[at * 2] << 8) | packed[at * 2 + 1] : packed[at];
+            samples[c] = static_cast<uint8_t>(std::min(sample, maxValue) * 255 / maxValue);
+        }
+        if (channels == 1) samples[1] = samples[2] = samples[0];
+        pixels[i * 4 + 0] = samples[2];
+        pixels[i * 4 + 1] = samples[1];
+        pixels[i * 4 + 2] = samples[0];
+        pixels[i * 4 + 3] = samples[3];
+    }
+    return true;
+}
+
+bool FileFrameSource::ReadY4mHeader() {
+    // The rest of the header line after "YU"
+    std::string header;
+    for (int c = getc(file); c != '\n'; c = getc(file)) {
+        if (c == EOF || header.size() > 4096) return false;
+        header += static_cast<char>(c);
+    }
+    if (header.compare(0, 8, "V4MPEG2 ") != 0) return false;
+
+    std::string colourSpace = "420";
+    size_t pos = 8;
+    while (pos < header.size()) {
+        size_t end = header.find(' ', pos);
+        if (end == std::string::npos) end = header.size();
+        std::string token = header.substr(pos, end - pos);
+        pos = end + 1;
+        if (token.empty()) continue;
+
+        switch (token[0]) {
+        case 'W': width = atoi(token.c_str() + 1); break;
+        case 'H': height = atoi(token.c_str() + 1); break;
+        case 'C': colourSpace = token.substr(1); break;
+        case 'F': {
+            int num = 0, den = 0;
+            if (sscanf(token.c_str() + 1, "%d:%d", &num, &den) == 2 && num > 0 && den > 0) {
+                fps = static_cast<double>(num) / den;
+            }
+            break;
+        }
+        }
+    }
+
+    // 8-bit tags only; the 4:2:0 variants differ in chroma siting, which is ignored here
+    if (colourSpace == "420" || colourSpace == "420jpeg" || colourSpace == "420paldv" || colourSpace == "420mpeg2") {
+        chromaShiftX = 1;
+        chromaShiftY = 1;
+    }
+    else if (colourSpace == "422") { chromaShiftX = 1; chromaShiftY = 0; }
+    else if (colourSpace == "444") { chromaShiftX = 0; chromaShiftY = 0; }
+    else if (colourSpace == "mono") { mono = true; }
+    else return false;  // High bit depth (420p10, 444p12, mono16, ...) and alpha variants
+
+    if (width <= 0 || height <= 0 || width > 32768 || height > 32768) return false;
+
+    size_t lumaSize = static_cast<size_t>(width) * height;
+    size_t chromaSize = mono ? 0 : static_cast<size_t>((width + (1 << chromaShiftX) - 1) >> chromaShiftX) *
+        ((height + (1 << chromaShiftY) - 1) >> chromaShiftY);
+    packed.resize(lumaSize + chromaSize * 2);
+    return true;
+}
+
+// FRAME marker, optionally followed by parameters
+bool FileFrameSource::ReadY4mFrameMarker() {
+    char marker[5];
+    if (fread(marker, 1, 5, file) != 5 || memcmp(marker, "FRAME", 5) != 0) return false;
+    for (int c = getc(file); c != '\n'; c = getc(file)) {
+        if (c == EOF) return false;
+    }
+    return true;
+}
+
+bool FileFrameSource::ReadY4mFrame(uint8_t* pixels) {
+    if (!ReadY4mFrameMarker()) return false;
+
+    if (fread(packed.data(), 1, packed.size(), file) != packed.size()) return false;
+
+    int chromaWidth = (width + (1 << chromaShiftX) - 1) >> chromaShiftX;
+    int chromaHeight = (height + (1 << chromaShiftY) - 1) >> chromaShiftY;
+    const uint8_t* planeY = packed.data();
+    const uint8_t* planeU = planeY + static_cast<size_t>(width) * height;
+    const uint8_t* planeV = planeU + static_cast<size_t>(chromaWidth) * chromaHeight;
+
+    for (int y = 0; y < height; y++) {
+        const uint8_t* rowY = planeY + static_cast<size_t>(y) * width;
+        const uint8_t* rowU = planeU + static_cast<size_t>(y >> chromaShiftY) * chromaWidth;
+        const uint8_t* rowV = planeV + static_cast<size_t>(y >> chromaShiftY) * chromaWidth;
+        uint8_t* out = pixels + static_cast<size_t>(y) * width * 4;
+
+        // BT.601 limited range, which is what ffmpeg writes unless told otherwise
+        for (int x = 0; x < width; x++) {
+            int c = 298 * (rowY[x] - 16);
+            int d = mono ? 0 : rowU[x >> chromaShiftX] - 128;
+            int e = mono ? 0 : rowV[x >> chromaShiftX] - 128;
+            out[x * 4 + 0] = static_cast<uint8_t>(clamp((c + 516 * d + 128) >> 8, 0, 255));
+            out[x * 4 + 1] = static_cast<uint8_t>(clamp((c - 100 * d - 208 * e + 128) >> 8, 0, 255));
+            out[x * 4 + 2] = static_cast<uint8_t>(clamp((c + 409 * e + 128) >> 8, 0, 255));
+            out[x * 4 + 3] = 255;
+        }
+    }
+    return true;
+}
+
+bool FileFrameSource::NextFrame(FrameView& view) {
+    pixels.resize(static_cast<size_t>(width) * height * 4);
+    return NextFrameInto(pixels.data(), view);
+}
+
+bool FileFrameSource::NextFrameInto(uint8_t* dst, FrameView& view) {
+    if (!file) return false;
+
+    bool ok = false;
+    switch (format) {
+    case Format::Ppm:
+    case Format::Pam: ok = ReadNetpbmFrame(dst); break;
+    case Format::Y4m: ok = ReadY4mFrame(dst); break;
+    case Format::Raw: {
+        size_t bytes = static_cast<size_t>(width) * height * 4;
+        size_t offset = prefixBytes;
+        memcpy(dst, prefix, prefixBytes);
+        prefixBytes = 0;
+        ok = fread(dst + offset, 1, bytes - offset, file) == bytes - offset;
+        break;
+    }
+    }
+    if (!ok) return false;
+
+    view.pixels = dst;
+    view.width = width;
+    view.height = height;
+    view.stride = static_cast<size_t>(width) * 4;
+    view.index = index;
+    view.timestamp = FrameTimestamp(index, fps);
+    view.fullDamage = true;
+    view.damage.clear();
+    index++;
+    return true;
+}
+
+// Seekable files jump ahead and read only the last byte, which shows whether the frame
+// is complete; pipes are read through
+bool FileFrameSource::SkipBytes(size_t count) {
+    if (count == 0) return true;
+#ifdef _WIN32
+    bool jumped = _fseeki64(file, static_cast<long long>(count - 1), SEEK_CUR) == 0;
+#else
+    bool jumped = fseeko(file, static_cast<off_t>(count - 1), SEEK_CUR) == 0;
+#endif
+    if (jumped) return getc(file) != EOF;
+
+    uint8_t buffer[65536];
+    while (count > 0) {
+        size_t chunk = std::min(count, sizeof(buffer));
+        if (fread(buffer, 1, chunk, file) != chunk) return false;
+        count -= chunk;
+    }
+    return true;
+}
+
+bool FileFrameSource::SkipFrame() {
+    if (!file) return false;
+
+    bool ok = false;
+    switch (format) {
+    case Format::Ppm:
+    case Format::Pam: ok = NextNetpbmHeader() && SkipBytes(packed.size()); break;
+    case Format::Y4m: ok = ReadY4mFrameMarker() && SkipBytes(packed.size()); break;
+    case Format::Raw: {
+        size_t bytes = static_cast<size_t>(width) * height * 4;
+        ok = SkipBytes(bytes - prefixBytes);
+        prefixBytes = 0;
+        break;
+    }
+    }
+    if (ok) index++;
+    return ok;
+}
+
+unsigned long long FileFrameSource::Skip(unsigned long long count) {
+    unsigned long long skipped = 0;
+    while (skipped < count && SkipFrame()) skipped++;
+    return skipped;
+}
+
+FileSequenceSource::FileSequenceSource(std::vector<std::string> paths, int rawWidth, int rawHeight, double fps)
+    : paths(std::move(paths)), rawWidth(rawWidth), rawHeight(rawHeight), fps(fps > 0.0 ? fps : 60.0) {}
+
+bool FileSequenceSource::Open() {
+    if (!OpenNext()) return false;
+    width = current->Width();
+    height = current->Height();
+    return true;
+}
+
+bool FileSequenceSource::OpenNext() {
+    current.reset();
+    if (next >= paths.size()) return false;
+    current.reset(new FileFrameSource());
+    return current->Open(paths[next++], rawWidth, rawHeight, fps);
+}
+
+bool FileSequenceSource::NextFrame(FrameView& view) {
+    if (!current && !Open()) return false;
+
+    while (!current->NextFrame(view)) {
+        if (!OpenNext()) return false;
+        if (current->Width() != width || current->Height() != height) return false;
+    }
+
+    view.index = index;
+    view.timestamp = FrameTimestamp(index, current->Fps());
+    index++;
+    return true;
+}
+
+// Whole files are skipped by seeking over their frames; none of them is decoded
+unsigned long long FileSequenceSource::Skip(unsigned long long count) {
+    if (!current && !Open()) return 0;
+
+    unsigned long long skipped = 0;
+    while (skipped < count) {
+        skipped += current->Skip(count - skipped);
+        if (skipped == count || !OpenNext()) break;
+        if (current->Width() != width || current->Height() != height) break;
+    }
+    index += skipped;
+    return skipped;
+}
+
+std::unique_ptr<FrameSource> OpenFrameFile(const std::string& path, int rawWidth, int rawHeight, double fps) {
+    std::unique_ptr<FileFrameSource> source(new FileFrameSource());
+    if (!source->Open(path, rawWidth, rawHeight, fps)) return nullptr;
+    return source;
+}
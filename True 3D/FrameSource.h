@@ -0,0 +1,189 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DepthPipeline.h"
+
+// Where frames come from. A source owns its buffers and reuses them for every frame,
+// so acquiring a frame never allocates; the view it hands out stays valid until the
+// next call to NextFrame.
+
+struct FrameView {
+    const uint8_t* pixels = nullptr;  // Top-down 32-bit BGRA
+    int width = 0;
+    int height = 0;
+    size_t stride = 0;                // Bytes from one row to the next
+    unsigned long long index = 0;     // Position in the stream, starting at 0
+    std::chrono::microseconds timestamp{ 0 };  // Presentation time relative to the first frame
+
+    // Damage since the previous frame. With fullDamage set anything may have changed and
+    // damage is meaningless; otherwise only the listed rectangles differ (none: identical).
+    bool fullDamage = true;
+    std::vector<MaskRect> damage;
+
+    bool Unchanged() const { return !fullDamage && damage.empty(); }
+};
+
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    // Fills view with the next frame. Returns false at the end of the stream or when the
+    // source cannot deliver any more frames.
+    virtual bool NextFrame(FrameView& view) = 0;
+
+    virtual int Width() const = 0;
+    virtual int Height() const = 0;
+
+    // Moves past up to count frames without delivering them and returns how many there
+    // were. This reads every frame; sources that can jump ahead without decoding do.
+    virtual unsigned long long Skip(unsigned long long count);
+};
+
+// Copies a view into a tightly packed width x height BGRA buffer
+void CopyFrame(const FrameView& view, uint8_t* dst);
+
+// Deterministic test content; the same scene, size and frame index always give the
+// same pixels
+enum class SyntheticScene {
+    Gradient,   // Static smooth colour gradient
+    Text,       // Static page of text with a blinking caret
+    Photo,      // Static smooth image with fine grain
+    Scrolling,  // Page of text scrolling up
+    Video,      // Full-screen animation, every pixel changes every frame
+};
+
+class SyntheticFrameSource : public FrameSource {
+public:
+    // frameCount 0 produces frames forever
+    SyntheticFrameSource(SyntheticScene scene, int width, int height, double fps = 60.0,
+        unsigned long long frameCount = 0, int scrollSpeed = 4);
+
+    bool NextFrame(FrameView& view) override;
+    int Width() const override { return width; }
+    int Height() const override { return height; }
+
+private:
+    void RenderRows(int y0, int y1);
+    void Pixel(int x, int y, uint8_t* bgra) const;
+    MaskRect CaretRect() const;
+    bool CaretVisible(unsigned long long frame) const { return (frame / 30) % 2 == 0; }
+
+    SyntheticScene scene;
+    int width;
+    int height;
+    double fps;
+    unsigned long long frameCount;
+    int scrollSpeed;
+    unsigned long long index = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Reads frames from a file or a pipe ("-" is stdin):
+//   raw  headerless BGRA frames, width and height must be given
+//   PPM  binary P6 images, one after another (as written by ffmpeg -f image2pipe)
+//   PAM  P7 images with grey, RGB or RGB_ALPHA tuples, one after another
+//   Y4M  YUV4MPEG2 streams with 4:2:0, 4:2:2, 4:4:4 or mono planes, 8 bits
+// The format is taken from the stream header; anything without a known signature is raw.
+class FileFrameSource : public FrameSource {
+public:
+    enum class Format { Raw, Ppm, Pam, Y4m };
+
+    FileFrameSource() = default;
+    ~FileFrameSource() override;
+
+    FileFrameSource(const FileFrameSource&) = delete;
+    FileFrameSource& operator=(const FileFrameSource&) = delete;
+
+    // fps is only used for timestamps of raw, PPM and PAM streams; Y4M carries its own rate.
+    // Returns false when the file cannot be opened or its header is invalid.
+    bool Open(const std::string& path, int rawWidth = 0, int rawHeight = 0, double fps = 60.0);
+
+    bool NextFrame(FrameView& view) override;
+
+    // Decodes the next frame straight into dst, a tightly packed Width() x Height() BGRA
+    // buffer owned by the caller; the view then points at dst. Raw frames are read into
+    // it without any intermediate copy.
+    bool NextFrameInto(uint8_t* dst, FrameView& view);
+
+    // Moves past the next frame without decoding it; files are seeked over, pipes read
+    bool SkipFrame();
+    unsigned long long Skip(unsigned long long count) override;
+
+    int Width() const override { return width; }
+    int Height() const override { return height; }
+    Format StreamFormat() const { return format; }
+    int ChromaShiftX() const { return chromaShiftX; }
+    int ChromaShiftY() const { return chromaShiftY; }
+    double Fps() const { return fps; }
+
+private:
+    bool SetImageSize(int w, int h, int depth, int maxval);
+    bool ReadPpmHeader();
+    bool ReadPamHeader();
+    bool ReadY4mHeader();
+    bool NextNetpbmHeader();
+    bool ReadNetpbmFrame(uint8_t* pixels);
+    bool ReadY4mFrameMarker();
+    bool ReadY4mFrame(uint8_t* pixels);
+    bool SkipBytes(size_t count);
+    int ReadPpmNumber();
+
+    FILE* file = nullptr;
+    bool ownsFile = false;
+    Format format = Format::Raw;
+    int width = 0;
+    int height = 0;
+    double fps = 60.0;
+    int maxValue = 255;     // PPM/PAM sample range
+    int channels = 3;       // PPM/PAM samples per pixel
+    int chromaShiftX = 1;   // Y4M chroma subsampling, log2
+    int chromaShiftY = 1;
+    bool mono = false;
+    bool headerPending = false;  // First PPM/PAM header was already read by Open
+    uint8_t prefix[2] = {};      // Raw bytes of the first frame already read by Open
+    size_t prefixBytes = 0;
+    unsigned long long index = 0;
+    std::vector<uint8_t> pixels;  // Frame buffer for NextFrame
+    std::vector<uint8_t> packed;  // Undecoded RGB or YUV planes
+};
+
+// Plays a list of files back to back as one stream, e.g. a directory of numbered
+// images. Each file may hold one frame or many. Every file must have the size of the
+// first; indices and timestamps run on across files.
+class FileSequenceSource : public FrameSource {
+public:
+    FileSequenceSource(std::vector<std::string> paths, int rawWidth = 0, int rawHeight = 0, double fps = 60.0);
+
+    // Opens the first file to learn the frame size; false if it cannot be read
+    bool Open();
+
+    bool NextFrame(FrameView& view) override;
+    unsigned long long Skip(unsigned long long count) override;
+    int Width() const override { return width; }
+    int Height() const override { return height; }
+
+    // File the last frame came from
+    const std::string& CurrentPath() const { return paths[std::min(next, paths.size()) - 1]; }
+
+private:
+    bool OpenNext();
+
+    std::vector<std::string> paths;
+    int rawWidth;
+    int rawHeight;
+    double fps;
+    size_t next = 0;
+    int width = 0;
+    int height = 0;
+    unsigned long long index = 0;
+    std::unique_ptr<FileFrameSource> current;
+};
+
+// Opens path with FileFrameSource; nullptr when it cannot be read
+std::unique_ptr<FrameSource> OpenFrameFile(const std::string& path, int rawWidth = 0, int rawHeight = 0, double fps = 60.0);
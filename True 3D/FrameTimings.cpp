@@ -0,0 +1,116 @@
+// FrameTimings.cpp : Stage histograms and their CSV dump.
+//
+
+#include "FrameTimings.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+
+const char* TimedStageName(int stage) {
+    static const char* names[TIMED_STAGE_COUNT] = {
+        "capture", "analysis", "smoothing", "blur", "composite", "process", "present", "latency",
+    };
+    return stage >= 0 && stage < TIMED_STAGE_COUNT ? names[stage] : "unknown";
+}
+
+void DurationHistogram::Add(const DurationHistogram& other) {
+    for (int i = 0; i < BUCKET_COUNT; i++) Increment(counts[i], other.counts[i].load(std::memory_order_relaxed));
+    Increment(count, other.Count());
+    Increment(sum, other.sum.load(std::memory_order_relaxed));
+    if (other.Max() > Max()) max.store(other.Max(), std::memory_order_relaxed);
+}
+
+double DurationHistogram::Mean() const {
+    uint64_t values = Count();
+    return values ? static_cast<double>(sum.load(std::memory_order_relaxed)) / values : 0.0;
+}
+
+uint64_t DurationHistogram::Percentile(double fraction) const {
+    // Buckets are read once each, so a concurrent writer can only make the total lag
+    uint64_t total = 0;
+    uint64_t snapshot[BUCKET_COUNT];
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        snapshot[i] = counts[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+    }
+    if (total == 0) return 0;
+
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * total + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        seen += snapshot[i];
+        if (seen >= rank) return std::min(BucketUpperBound(i), Max());
+    }
+    return Max();
+}
+
+void FrameTimingLog::RecentSamples(std::vector<Sample>& samples) const {
+    uint64_t end = written.load(std::memory_order_acquire);
+    uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+    std::vector<Sample> copied;
+    copied.reserve(static_cast<size_t>(end - begin));
+    for (uint64_t index = begin; index < end; index++) {
+        const RingSlot& slot = ring[index & (RING_SIZE - 1)];
+        uint64_t value = slot.value.load(std::memory_order_relaxed);
+        copied.push_back({ slot.frame.load(std::memory_order_relaxed), static_cast<int>(value >> 56), value & NANOSECOND_MASK });
+    }
+
+    // Anything the writer may have started overwriting since is discarded
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t now = written.load(std::memory_order_relaxed);
+    uint64_t firstIntact = now > RING_SIZE ? now - RING_SIZE + 1 : 0;
+    for (uint64_t index = begin; index < end; index++) {
+        if (index >= firstIntact) samples.push_back(copied[static_cast<size_t>(index - begin)]);
+    }
+}
+
+bool WriteFrameTimingCsv(const std::string& summaryPath, const std::string& framesPath,
+    const FrameTimingLog* const* logs, size_t logCount) {
+    FILE* summary = fopen(summaryPath.c_str(), "w");
+    if (!summary) return false;
+    fprintf(summary, "stage,samples,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,deadline_ms,missed_deadlines\n");
+    for (int stage = 0; stage < TIMED_STAGE_COUNT; stage++) {
+        // Heap allocated: a histogram is a few kilobytes of counters
+        std::unique_ptr<DurationHistogram> merged(new DurationHistogram());
+        uint64_t missed = 0, budget = 0;
+        for (size_t i = 0; i < logCount; i++) {
+            merged->Add(logs[i]->Histogram(stage));
+            missed += logs[i]->MissedDeadlines(stage);
+            budget = std::max(budget, logs[i]->Budget(stage));
+        }
+        fprintf(summary, "%s,%llu,%.4f,%.4f,%.4f,%.4f,%.4f,", TimedStageName(stage),
+            static_cast<unsigned long long>(merged->Count()), merged->Mean() / 1e6, merged->Percentile(0.5) / 1e6,
+            merged->Percentile(0.9) / 1e6, merged->Percentile(0.99) / 1e6, merged->Max() / 1e6);
+        if (budget) fprintf(summary, "%.4f,%llu\n", budget / 1e6, static_cast<unsigned long long>(missed));
+        else fprintf(summary, ",\n");
+    }
+    bool ok = fclose(summary) == 0;
+
+    // One row per frame; stages a frame skipped (e.g. analysis of a recomposite) stay empty
+    std::map<unsigned long long, std::vector<double>> frames;
+    std::vector<FrameTimingLog::Sample> samples;
+    for (size_t i = 0; i < logCount; i++) logs[i]->RecentSamples(samples);
+    for (const FrameTimingLog::Sample& sample : samples) {
+        if (sample.stage < 0 || sample.stage >= TIMED_STAGE_COUNT) continue;
+        std::vector<double>& row = frames[sample.frame];
+        row.resize(TIMED_STAGE_COUNT, -1.0);
+        row[sample.stage] = sample.nanoseconds / 1e6;
+    }
+
+    FILE* perFrame = fopen(framesPath.c_str(), "w");
+    if (!perFrame) return false;
+    fprintf(perFrame, "frame");
+    for (int stage = 0; stage < TIMED_STAGE_COUNT; stage++) fprintf(perFrame, ",%s_ms", TimedStageName(stage));
+    fprintf(perFrame, "\n");
+    for (const auto& frame : frames) {
+        fprintf(perFrame, "%llu", frame.first);
+        for (double milliseconds : frame.second) {
+            if (milliseconds >= 0.0) fprintf(perFrame, ",%.4f", milliseconds);
+            else fprintf(perFrame, ",");
+        }
+        fprintf(perFrame, "\n");
+    }
+    return fclose(perFrame) == 0 && ok;
+}
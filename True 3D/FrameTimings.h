@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-stage frame timing for the live pipeline. Each pipeline thread records into its
+// own FrameTimingLog: a histogram per stage plus a ring of the most recent samples.
+// Recording takes no locks and never waits; any thread may read a log at any time,
+// e.g. to dump it while the pipeline keeps running.
+
+enum TimedStage {
+    TIMED_CAPTURE,
+    TIMED_ANALYSIS,   // Edge detection and depth estimation, CPU time over all workers
+    TIMED_SMOOTHING,  // CPU time over all workers
+    TIMED_BLUR,       // CPU time over all workers
+    TIMED_COMPOSITE,  // CPU time over all workers
+    TIMED_PROCESS,    // Wall time of the whole tile graph, or of a recomposite
+    TIMED_PRESENT,
+    TIMED_LATENCY,    // Capture to present
+    TIMED_STAGE_COUNT
+};
+
+const char* TimedStageName(int stage);
+
+// Log-linear histogram of durations in nanoseconds, in the style of HdrHistogram: each
+// power of two is split into 32 linear buckets, so every value is kept to within about
+// 3% from 1 ns up to 2^40 ns (18 minutes) in fixed memory. One thread records; other
+// threads may read concurrently and see each bucket's latest count.
+class DurationHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_MAGNITUDE = 40;
+    static const int BUCKET_COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    static int BucketIndex(uint64_t value) {
+        const uint64_t limit = (uint64_t(1) << MAX_MAGNITUDE) - 1;
+        if (value > limit) value = limit;
+        if (value < 2 * SUB_BUCKETS) return static_cast<int>(value);
+        int shift = 0;
+        while ((value >> shift) >= 2 * SUB_BUCKETS) shift++;
+        return (shift + 1) * SUB_BUCKETS + static_cast<int>((value >> shift) - SUB_BUCKETS);
+    }
+
+    // Largest value that lands in bucket index
+    static uint64_t BucketUpperBound(int index) {
+        if (index < 2 * SUB_BUCKETS) return static_cast<uint64_t>(index);
+        int shift = index / SUB_BUCKETS - 1;
+        uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKETS + SUB_BUCKETS);
+        return ((sub + 1) << shift) - 1;
+    }
+
+    // Only ever called by one thread, so plain loads and stores are enough
+    void Record(uint64_t value) {
+        Increment(counts[BucketIndex(value)], 1);
+        Increment(count, 1);
+        Increment(sum, value);
+        if (value > max.load(std::memory_order_relaxed)) max.store(value, std::memory_order_relaxed);
+    }
+
+    // Adds other's counts; this histogram must not be recorded into meanwhile
+    void Add(const DurationHistogram& other);
+
+    uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+    uint64_t Max() const { return max.load(std::memory_order_relaxed); }
+    double Mean() const;
+
+    // Smallest bucket bound at or below which fraction (0-1) of the values lie, capped at Max
+    uint64_t Percentile(double fraction) const;
+
+private:
+    static void Increment(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> counts[BUCKET_COUNT] = {};
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> sum{ 0 };
+    std::atomic<uint64_t> max{ 0 };
+};
+
+class FrameTimingLog {
+public:
+    static const size_t RING_SIZE = 4096;  // Samples kept for the per-frame dump, a few seconds' worth
+
+    struct Sample {
+        unsigned long long frame;
+        int stage;
+        uint64_t nanoseconds;
+    };
+
+    // Only called by the owning thread. A sample longer than a non-zero budget counts as
+    // a missed deadline of its stage.
+    void Record(TimedStage stage, unsigned long long frame, uint64_t nanoseconds, uint64_t budgetNanoseconds = 0) {
+        histograms[stage].Record(nanoseconds);
+        if (budgetNanoseconds) {
+            budgets[stage].store(budgetNanoseconds, std::memory_order_relaxed);
+            if (nanoseconds > budgetNanoseconds) {
+                missed[stage].store(missed[stage].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+
+        // Slot contents first, then the release store that publishes them
+        uint64_t index = written.load(std::memory_order_relaxed);
+        RingSlot& slot = ring[index & (RING_SIZE - 1)];
+        slot.frame.store(frame, std::memory_order_relaxed);
+        slot.value.store(static_cast<uint64_t>(stage) << 56 | (nanoseconds & NANOSECOND_MASK), std::memory_order_relaxed);
+        written.store(index + 1, std::memory_order_release);
+    }
+
+    const DurationHistogram& Histogram(int stage) const { return histograms[stage]; }
+    uint64_t MissedDeadlines(int stage) const { return missed[stage].load(std::memory_order_relaxed); }
+    uint64_t Budget(int stage) const { return budgets[stage].load(std::memory_order_relaxed); }
+
+    // Appends the samples still in the ring, oldest first. Slots the writer reused while
+    // they were being copied are left out.
+    void RecentSamples(std::vector<Sample>& samples) const;
+
+private:
+    static const uint64_t NANOSECOND_MASK = (uint64_t(1) << 56) - 1;
+
+    struct RingSlot {
+        std::atomic<uint64_t> frame{ 0 };
+        std::atomic<uint64_t> value{ 0 };  // Stage in the top 8 bits, nanoseconds below
+    };
+
+    DurationHistogram histograms[TIMED_STAGE_COUNT];
+    std::atomic<uint64_t> missed[TIMED_STAGE_COUNT] = {};
+    std::atomic<uint64_t> budgets[TIMED_STAGE_COUNT] = {};
+    RingSlot ring[RING_SIZE];
+    std::atomic<uint64_t> written{ 0 };
+};
+
+// Writes two CSV files: per stage over all logs, the sample count, mean, p50/p90/p99,
+// max and missed deadlines; and one row per recent frame with each stage's time, from
+// the logs' rings. False if either file cannot be written.
+bool WriteFrameTimingCsv(const std::string& summaryPath, const std::string& framesPath,
+    const FrameTimingLog* const* logs, size_t logCount);
+
+// Instrumentation policies. FrameTimingOn records into a FrameTimingLog. With
+// FrameTimingOff the log is an empty struct and every call, clock reads included,
+// inlines to nothing, so the instrumented code costs nothing when it is switched off.
+struct FrameTimingOn {
+    static const bool enabled = true;
+    using Log = FrameTimingLog;
+
+    static void Record(Log& log, TimedStage stage, unsigned long long frame, uint64_t nanoseconds,
+        uint64_t budgetNanoseconds = 0) {
+        log.Record(stage, frame, nanoseconds, budgetNanoseconds);
+    }
+
+    static bool WriteCsv(const std::string& summaryPath, const std::string& framesPath, const Log* const* logs,
+        size_t logCount) {
+        return WriteFrameTimingCsv(summaryPath, framesPath, logs, logCount);
+    }
+};
+
+struct FrameTimingOff {
+    static const bool enabled = false;
+    struct Log {};
+
+    static void Record(Log&, TimedStage, unsigned long long, uint64_t, uint64_t = 0) {}
+    static bool WriteCsv(const std::string&, const std::string&, const Log* const*, size_t) { return false; }
+};
+
+// Records the wall time from construction to destruction as one sample of stage
+template <typename Policy, bool Enabled = Policy::enabled>
+class ScopedStageTimer {
+public:
+    ScopedStageTimer(typename Policy::Log& log, TimedStage stage, unsigned long long frame, uint64_t budgetNanoseconds = 0)
+        : log(log), stage(stage), frame(frame), budget(budgetNanoseconds), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedStageTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        Policy::Record(log, stage, frame,
+            static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()), budget);
+    }
+
+    ScopedStageTimer(const ScopedStageTimer&) = delete;
+    ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+private:
+    typename Policy::Log& log;
+    TimedStage stage;
+    unsigned long long frame;
+    uint64_t budget;
+    std::chrono::steady_clock::time_point start;
+};
+
+template <typename Policy>
+class ScopedStageTimer<Policy, false> {
+public:
+    ScopedStageTimer(typename Policy::Log&, TimedStage, unsigned long long, uint64_t = 0) {}
+};
@@ -0,0 +1,299 @@
+// Presenter.cpp : Dirty rectangle tracking and the portable presenters.
+//
+
+#include "Presenter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+const std::vector<MaskRect>& DirtyRectTracker::Update(const uint8_t* pixels, int frameWidth, int frameHeight) {
+    size_t rowBytes = static_cast<size_t>(frameWidth) * 4;
+    rects.clear();
+
+    if (previous.empty() || frameWidth != width || frameHeight != height) {
+        width = frameWidth;
+        height = frameHeight;
+        previous.assign(pixels, pixels + rowBytes * height);
+        rects.push_back({ 0, 0, width, height });
+        dirtyFraction = 1.0f;
+        return rects;
+    }
+
+    int columns = (width + cellSize - 1) / cellSize;
+    cellDirty.resize(columns);
+    long long dirtyArea = 0;
+    size_t openBegin = 0;  // Rectangles that ended on the previous cell row and can grow down
+
+    for (int y0 = 0; y0 < height; y0 += cellSize) {
+        int y1 = std::min(y0 + cellSize, height);
+        std::fill(cellDirty.begin(), cellDirty.end(), 0);
+
+        for (int y = y0; y < y1; y++) {
+            const uint8_t* row = pixels + y * rowBytes;
+            const uint8_t* old = previous.data() + y * rowBytes;
+            if (memcmp(row, old, rowBytes) == 0) continue;
+
+            for (int c = 0; c < columns; c++) {
+                if (cellDirty[c]) continue;
+                size_t offset = static_cast<size_t>(c) * cellSize * 4;
+                size_t bytes = std::min(rowBytes - offset, static_cast<size_t>(cellSize) * 4);
+                if (memcmp(row + offset, old + offset, bytes) != 0) cellDirty[c] = 1;
+            }
+        }
+
+        // Horizontal runs of dirty cells; a run matching one directly above extends it
+        size_t rowBegin = rects.size();
+        for (int c = 0; c < columns;) {
+            if (!cellDirty[c]) {
+                c++;
+                continue;
+            }
+            int runStart = c;
+            while (c < columns && cellDirty[c]) c++;
+
+            int left = runStart * cellSize;
+            int right = std::min(c * cellSize, width);
+            for (int y = y0; y < y1; y++) {
+                memcpy(previous.data() + y * rowBytes + left * 4, pixels + y * rowBytes + left * 4, (right - left) * 4);
+            }
+            dirtyArea += static_cast<long long>(right - left) * (y1 - y0);
+
+            bool extended = false;
+            for (size_t i = openBegin; i < rowBegin; i++) {
+                if (rects[i].left == left && rects[i].right == right && rects[i].bottom == y0) {
+                    rects[i].bottom = y1;
+                    extended = true;
+                    break;
+                }
+            }
+            if (!extended) rects.push_back({ left, y0, right, y1 });
+        }
+
+        // Grown rectangles stay open; the new ones of this row join them
+        size_t nextOpen = rects.size();
+        for (size_t i = openBegin; i < rects.size(); i++) {
+            if (rects[i].bottom == y1) {
+                nextOpen = std::min(nextOpen, i);
+            }
+        }
+        openBegin = nextOpen;
+    }
+
+    if (rects.size() > maxRects) {
+        MaskRect bounds = rects.front();
+        for (const MaskRect& r : rects) {
+            bounds.left = std::min(bounds.left, r.left);
+            bounds.top = std::min(bounds.top, r.top);
+            bounds.right = std::max(bounds.right, r.right);
+            bounds.bottom = std::max(bounds.bottom, r.bottom);
+        }
+        rects.assign(1, bounds);
+    }
+
+    dirtyFraction = static_cast<float>(dirtyArea) / (static_cast<float>(width) * height);
+    return rects;
+}
+
+void CopyDirtyRects(const uint8_t* pixels, int width, const std::vector<MaskRect>& dirty, uint8_t* dst, size_t dstStride) {
+    size_t rowBytes = static_cast<size_t>(width) * 4;
+    for (const MaskRect& r : dirty) {
+        size_t bytes = static_cast<size_t>(r.right - r.left) * 4;
+        for (int y = r.top; y < r.bottom; y++) {
+            memcpy(dst + y * dstStride + r.left * 4, pixels + y * rowBytes + r.left * 4, bytes);
+        }
+    }
+}
+
+bool NullPresenter::Present(const uint8_t*, int width, int height, const std::vector<MaskRect>& dirty) {
+    frames++;
+    bytesTotal += static_cast<unsigned long long>(width) * height * 4;
+    for (const MaskRect& r : dirty) {
+        bytesDirty += static_cast<unsigned long long>(r.right - r.left) * (r.bottom - r.top) * 4;
+    }
+    return true;
+}
+
+FilePresenter::~FilePresenter() {
+    if (file && ownsFile) fclose(file);
+}
+
+bool FilePresenter::Open(const std::string& path, Format streamFormat, double streamFps,
+    int shiftX, int shiftY) {
+    if (path == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        file = stdout;
+        ownsFile = false;
+    }
+    else {
+        file = fopen(path.c_str(), "wb");
+        ownsFile = true;
+    }
+    format = streamFormat;
+    fps = streamFps > 0.0 ? streamFps : 60.0;
+    chromaShiftX = clamp(shiftX, 0, 1);
+    chromaShiftY = clamp(shiftY, 0, 1);
+    headerWritten = false;
+    return file != nullptr;
+}
+
+bool FilePresenter::Present(const uint8_t* pixels, int width, int height, const std::vector<MaskRect>&) {
+    if (!file) return false;
+    if (format == Format::Y4m) return WriteY4mFrame(pixels, width, height);
+
+    size_t bytes = static_cast<size_t>(width) * height * 4;
+    return fwrite(pixels, 1, bytes, file) == bytes;
+}
+
+bool FilePresenter::WriteY4mFrame(const uint8_t* pixels, int width, int height) {
+    if (!headerWritten) {
+        const char* chroma = chromaShiftY ? "420jpeg" : chromaShiftX ? "422" : "444";
+        fprintf(file, "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C%s\n", width, height,
+            static_cast<int>(fps * 1000.0 + 0.5), chroma);
+        headerWritten = true;
+    }
+
+    int chromaWidth = (width + (1 << chromaShiftX) - 1) >> chromaShiftX;
+    int chromaHeight = (height + (1 << chromaShiftY) - 1) >> chromaShiftY;
+    size_t lumaSize = static_cast<size_t>(width) * height;
+    size_t chromaSize = static_cast<size_t>(chromaWidth) * chromaHeight;
+    planes.resize(lumaSize + chromaSize * 2);
+    uint8_t* planeY = planes.data();
+    uint8_t* planeU = planeY + lumaSize;
+    uint8_t* planeV = planeU + chromaSize;
+
+    for (size_t i = 0; i < lumaSize; i++) {
+        int b = pixels[i * 4], g = pixels[i * 4 + 1], r = pixels[i * 4 + 2];
+        planeY[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+
+    // Chroma of each block is the average of its pixels' chroma
+    for (int cy = 0; cy < chromaHeight; cy++) {
+        for (int cx = 0; cx < chromaWidth; cx++) {
+            int sumU = 0, sumV = 0, count = 0;
+            for (int y = cy << chromaShiftY; y < std::min(height, (cy + 1) << chromaShiftY); y++) {
+                for (int x = cx << chromaShiftX; x < std::min(width, (cx + 1) << chromaShiftX); x++) {
+                    const uint8_t* p = pixels + (static_cast<size_t>(y) * width + x) * 4;
+                    sumU += ((-38 * p[2] - 74 * p[1] + 112 * p[0] + 128) >> 8) + 128;
+                    sumV += ((112 * p[2] - 94 * p[1] - 18 * p[0] + 128) >> 8) + 128;
+                    count++;
+                }
+            }
+            planeU[cy * chromaWidth + cx] = static_cast<uint8_t>((sumU + count / 2) / count);
+            planeV[cy * chromaWidth + cx] = static_cast<uint8_t>((sumV + count / 2) / count);
+        }
+    }
+
+    return fputs("FRAME\n", file) >= 0 && fwrite(planes.data(), 1, planes.size(), file) == planes.size();
+}
+
+SharedMemoryPresenter::~SharedMemoryPresenter() {
+    Close();
+}
+
+void SharedMemoryPresenter::Close() {
+#ifdef _WIN32
+    if (mapping) UnmapViewOfFile(mapping);
+    if (handle) CloseHandle(handle);
+    handle = nullptr;
+#else
+    if (mapping) {
+        munmap(mapping, mappingSize);
+        shm_unlink(ShmPath().c_str());
+    }
+#endif
+    mapping = nullptr;
+    header = nullptr;
+    frame = nullptr;
+}
+
+bool SharedMemoryPresenter::Open(const std::string& regionName, int width, int height) {
+    Close();
+    if (regionName.empty() || width <= 0 || height <= 0) return false;
+    name = regionName;
+    mappingSize = sizeof(SharedFrameHeader) + static_cast<size_t>(width) * height * 4;
+
+#ifdef _WIN32
+    unsigned long long size = mappingSize;
+    handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+        static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name.c_str());
+    if (!handle) return false;
+    mapping = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, mappingSize);
+#else
+    int fd = shm_open(ShmPath().c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0) return false;
+    if (ftruncate(fd, static_cast<off_t>(mappingSize)) == 0) {
+        mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) mapping = nullptr;
+    }
+    close(fd);
+    if (!mapping) shm_unlink(ShmPath().c_str());
+#endif
+    if (!mapping) {
+        Close();
+        return false;
+    }
+
+    header = static_cast<SharedFrameHeader*>(mapping);
+    frame = static_cast<uint8_t*>(mapping) + sizeof(SharedFrameHeader);
+    memcpy(header->magic, "T3DSHM1", 8);
+    header->width = width;
+    header->height = height;
+    header->stride = width * 4;
+    header->reserved = 0;
+    header->sequence.store(0, std::memory_order_release);
+    return true;
+}
+
+#ifndef _WIN32
+// POSIX shared memory names start with a single slash
+std::string SharedMemoryPresenter::ShmPath() const {
+    return name[0] == '/' ? name : "/" + name;
+}
+#endif
+
+bool SharedMemoryPresenter::Present(const uint8_t* pixels, int width, int height, const std::vector<MaskRect>& dirty) {
+    if (!header || static_cast<uint32_t>(width) != header->width || static_cast<uint32_t>(height) != header->height) {
+        return false;
+    }
+    if (dirty.empty()) return true;
+
+    // Readers retry while the sequence is odd or changed during their copy. The fence
+    // keeps the pixel writes after the odd value; the release store publishes them.
+    uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    CopyDirtyRects(pixels, width, dirty, frame, header->stride);
+    header->sequence.store(sequence + 2, std::memory_order_release);
+    return true;
+}
+
+bool MockPresenter::Present(const uint8_t* pixels, int frameWidth, int frameHeight, const std::vector<MaskRect>& dirty) {
+    if (frameWidth != width || frameHeight != height) {
+        width = frameWidth;
+        height = frameHeight;
+        frame.assign(static_cast<size_t>(width) * height * 4, 0);
+    }
+    CopyDirtyRects(pixels, width, dirty, frame.data(), static_cast<size_t>(width) * 4);
+    history.push_back(dirty);
+    return true;
+}
+
+bool MockPresenter::Matches(const uint8_t* pixels) const {
+    return !frame.empty() && memcmp(frame.data(), pixels, frame.size()) == 0;
+}
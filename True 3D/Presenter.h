@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "DepthPipeline.h"
+
+// Where composited frames go. A presenter receives the full frame plus the list of
+// rectangles that differ from the frame it was given last time, and only has to move
+// those. An empty list means the frame is identical to the previous one.
+class Presenter {
+public:
+    virtual ~Presenter() = default;
+
+    // pixels is a tightly packed width x height BGRA frame. Returns false when the
+    // frame could not be delivered.
+    virtual bool Present(const uint8_t* pixels, int width, int height, const std::vector<MaskRect>& dirty) = 0;
+};
+
+// Finds what changed between consecutive frames by comparing them cell by cell against
+// a private copy of the previous one. Neighbouring dirty cells are merged into larger
+// rectangles; past maxRects the whole changed area is reported as its bounding box.
+class DirtyRectTracker {
+public:
+    explicit DirtyRectTracker(int cellSize = TILE_SIZE, size_t maxRects = 32)
+        : cellSize(cellSize), maxRects(maxRects) {}
+
+    // Returns the rectangles of frame that differ from the previous call's frame. The
+    // first frame, and any frame after a size change, is dirty as a whole.
+    const std::vector<MaskRect>& Update(const uint8_t* pixels, int width, int height);
+
+    // Forgets the previous frame, so the next one is fully dirty
+    void Reset() { previous.clear(); }
+
+    // Fraction of the last frame's area that was dirty
+    float DirtyFraction() const { return dirtyFraction; }
+
+private:
+    int cellSize;
+    size_t maxRects;
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> previous;
+    std::vector<uint8_t> cellDirty;
+    std::vector<MaskRect> rects;
+    float dirtyFraction = 0.0f;
+};
+
+// Copies the dirty rectangles of a width x height BGRA frame into dst, which has the
+// same size but may have a different stride
+void CopyDirtyRects(const uint8_t* pixels, int width, const std::vector<MaskRect>& dirty, uint8_t* dst, size_t dstStride);
+
+// Discards frames; counts what a real presenter would have had to upload
+class NullPresenter : public Presenter {
+public:
+    bool Present(const uint8_t* pixels, int width, int height, const std::vector<MaskRect>& dirty) override;
+
+    unsigned long long Frames() const { return frames; }
+    unsigned long long BytesDirty() const { return bytesDirty; }  // Payload of the dirty rectangles
+    unsigned long long BytesTotal() const { return bytesTotal; }  // Payload of whole frames
+
+private:
+    unsigned long long frames = 0;
+    unsigned long long bytesDirty = 0;
+    unsigned long long bytesTotal = 0;
+};
+
+// Writes every frame to a file or a pipe ("-" is stdout), either as headerless BGRA or
+// as a Y4M stream (BT.601 limited range, the inverse of FileFrameSource). Files need
+// whole frames, so dirty rectangles are ignored.
+class FilePresenter : public Presenter {
+public:
+    enum class Format { Raw, Y4m };
+
+    FilePresenter() = default;
+    ~FilePresenter() override;
+
+    FilePresenter(const FilePresenter&) = delete;
+    FilePresenter& operator=(const FilePresenter&) = delete;
+
+    // Y4M streams get fps and chroma subsampling (log2 per axis, so 1/1 is 4:2:0) in
+    // their header, which is written with the first frame
+    bool Open(const std::string& path, Format format = Format::Raw, double fps = 60.0,
+        int chromaShiftX = 0, int chromaShiftY = 0);
+    bool Present(const uint8_t* pixels, int width, int height, const std::vector<MaskRect>& dirty) override;
+
+private:
+    bool WriteY4mFrame(const uint8_t* pixels, int width, int height);
+
+    FILE* file = nullptr;
+    bool ownsFile = false;
+    Format format = Format::Raw;
+    double fps = 60.0;
+    int chromaShiftX = 0;
+    int chromaShiftY = 0;
+    bool headerWritten = false;
+    std::vector<uint8_t> planes;  // Y4M frame being encoded
+};
+
+// Publishes frames in a named shared memory region for another process to read. Only
+// dirty rectangles are written. The region starts with a SharedFrameHeader; sequence
+// is odd while a frame is being written and even once it is complete. Readers load it
+// with acquire, copy the pixels, issue an acquire fence and load it again; the copy is
+// whole if both loads returned the same even value.
+struct SharedFrameHeader {
+    char magic[8];          // "T3DSHM1"
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t reserved;
+    std::atomic<uint64_t> sequence;  // Lock-free on every supported target, so valid across processes
+};
+
+class SharedMemoryPresenter : public Presenter {
+public:
+    SharedMemoryPresenter() = default;
+    ~SharedMemoryPresenter() override;
+
+    SharedMemoryPresenter(const SharedMemoryPresenter&) = delete;
+    SharedMemoryPresenter& operator=(const SharedMemoryPresenter&) = delete;
+
+    // Creates (or reuses) the region name, sized for width x height frames. The region is
+    // removed again when the presenter closes; readers that mapped it keep their view.
+    bool Open(const std::string& name, int width, int height);
+    bool Present(const uint8_t* pixels, int width, int height, const std::vector<MaskRect>& dirty) override;
+
+private:
+    void Close();
+#ifndef _WIN32
+    std::string ShmPath() const;
+#endif
+
+    std::string name;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+#ifdef _WIN32
+    void* handle = nullptr;
+#endif
+    SharedFrameHeader* header = nullptr;
+    uint8_t* frame = nullptr;
+};
+
+// Rebuilds frames from nothing but the dirty rectangles it is given and records them,
+// so a test can check that applying the reported damage reproduces every frame
+class MockPresenter : public Presenter {
+public:
+    bool Present(const uint8_t* pixels, int width, int height, const std::vector<MaskRect>& dirty) override;
+
+    // Whether the rebuilt frame equals pixels
+    bool Matches(const uint8_t* pixels) const;
+
+    const std::vector<uint8_t>& Frame() const { return frame; }
+    const std::vector<std::vector<MaskRect>>& History() const { return history; }
+
+private:
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> frame;
+    std::vector<std::vector<MaskRect>> history;
+};
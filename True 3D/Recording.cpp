@@ -0,0 +1,338 @@
+// Recording.cpp : Capture recorder and memory-mapped replay.
+//
+
+#include "Recording.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char RECORDING_MAGIC[8] = "T3DREC1";
+static const uint32_t FULL_DAMAGE = 0xFFFFFFFFu;
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool IsRecordingFile(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    char magic[8] = {};
+    bool match = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, RECORDING_MAGIC, 8) == 0;
+    fclose(file);
+    return match;
+}
+
+FrameRecorder::~FrameRecorder() {
+    Close();
+}
+
+bool FrameRecorder::Open(const std::string& path, int frameWidth, int frameHeight) {
+    Close();
+    file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    RecordingHeader header = {};
+    memcpy(header.magic, RECORDING_MAGIC, 8);
+    header.headerSize = sizeof(RecordingHeader);
+    header.width = frameWidth;
+    header.height = frameHeight;
+    header.configSize = sizeof(DepthIllusionConfig);
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    width = frameWidth;
+    height = frameHeight;
+    firstFrame = true;
+    forceFullDamage = false;
+    offset = sizeof(RecordingHeader);
+    closing = false;
+    writeFailed = false;
+    framesWritten = 0;
+    framesDropped = 0;
+
+    buffers.resize(std::max<size_t>(1, bufferCount));
+    configRecords.clear();
+    freeBuffers.clear();
+    for (Record& record : buffers) freeBuffers.push_back(&record);
+    writer = std::thread(&FrameRecorder::WriterLoop, this);
+    return true;
+}
+
+bool FrameRecorder::Close() {
+    if (!file) return true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    queued.notify_all();
+    writer.join();
+
+    bool ok = fclose(file) == 0 && !writeFailed;
+    file = nullptr;
+    return ok;
+}
+
+bool FrameRecorder::WriteConfig(const DepthIllusionConfig& config) {
+    if (!file) return false;
+
+    // Settings are never dropped and never wait for a frame buffer: each gets a small
+    // record of its own, released once written
+    Record* record;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        configRecords.emplace_back();
+        record = &configRecords.back();
+    }
+
+    record->header = {};
+    record->header.type = RecordHeader::Config;
+    record->header.payloadSize = AlignUp(sizeof(DepthIllusionConfig), 8);
+    record->payload.assign(record->header.payloadSize, 0);
+    memcpy(record->payload.data(), &config, sizeof(DepthIllusionConfig));
+    return Enqueue(record);
+}
+
+bool FrameRecorder::WriteFrame(const FrameView& view) {
+    if (!file || view.width != width || view.height != height) return false;
+
+    Record* record = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!freeBuffers.empty()) {
+            record = freeBuffers.back();
+            freeBuffers.pop_back();
+        }
+        else {
+            framesDropped++;
+        }
+    }
+    // The next frame's damage is relative to this one, which replay will never see
+    if (!record) {
+        forceFullDamage = true;
+        return false;
+    }
+
+    if (firstFrame) {
+        firstTimestamp = view.timestamp;
+        firstFrame = false;
+    }
+
+    bool full = view.fullDamage || forceFullDamage;
+    forceFullDamage = false;
+    uint32_t damageCount = full ? 0 : static_cast<uint32_t>(view.damage.size());
+    size_t damageBytes = damageCount * sizeof(MaskRect);
+    size_t rowBytes = static_cast<size_t>(width) * 4;
+
+    // Pixels start on an aligned file offset so replayed views are aligned in memory
+    uint64_t payloadStart = offset + sizeof(RecordHeader);
+    size_t pixelOffset = static_cast<size_t>(AlignUp(payloadStart + damageBytes, RECORDING_PIXEL_ALIGNMENT) - payloadStart);
+
+    record->header = {};
+    record->header.type = RecordHeader::Frame;
+    record->header.damageCount = full ? FULL_DAMAGE : damageCount;
+    record->header.timestamp = (view.timestamp - firstTimestamp).count();
+    record->header.payloadSize = AlignUp(pixelOffset + rowBytes * height, 8);
+    record->payload.resize(record->header.payloadSize);
+
+    uint8_t* payload = record->payload.data();
+    memset(payload, 0, pixelOffset);
+    if (damageCount) memcpy(payload, view.damage.data(), damageBytes);
+    for (int y = 0; y < height; y++) {
+        memcpy(payload + pixelOffset + y * rowBytes, view.pixels + y * view.stride, rowBytes);
+    }
+    memset(payload + pixelOffset + rowBytes * height, 0, record->header.payloadSize - pixelOffset - rowBytes * height);
+    return Enqueue(record);
+}
+
+// Records are written in the order they are queued, which fixes their file offsets
+bool FrameRecorder::Enqueue(Record* record) {
+    offset += sizeof(RecordHeader) + record->header.payloadSize;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(record);
+    }
+    queued.notify_one();
+    return true;
+}
+
+void FrameRecorder::WriterLoop() {
+    while (true) {
+        Record* record;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.wait(lock, [&] { return closing || !pending.empty(); });
+            if (pending.empty()) return;
+            record = pending.front();
+            pending.pop_front();
+        }
+
+        bool ok = fwrite(&record->header, sizeof(RecordHeader), 1, file) == 1 &&
+            fwrite(record->payload.data(), 1, record->payload.size(), file) == record->payload.size();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ok) writeFailed = true;
+            if (record->header.type == RecordHeader::Config) {
+                // Queued in order, so this is the oldest one
+                configRecords.pop_front();
+                continue;
+            }
+            if (ok) framesWritten++;
+            freeBuffers.push_back(record);
+        }
+    }
+}
+
+unsigned long long FrameRecorder::FramesWritten() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return framesWritten;
+}
+
+unsigned long long FrameRecorder::FramesDropped() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return framesDropped;
+}
+
+ReplayFrameSource::~ReplayFrameSource() {
+    Close();
+}
+
+void ReplayFrameSource::Close() {
+#ifdef _WIN32
+    if (mapping) UnmapViewOfFile(mapping);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (mapping) munmap(const_cast<uint8_t*>(mapping), mappingSize);
+#endif
+    mapping = nullptr;
+    mappingSize = 0;
+    frames.clear();
+    configs.clear();
+    next = 0;
+    seeked = false;
+}
+
+bool ReplayFrameSource::Open(const std::string& path) {
+    Close();
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    fileHandle = handle;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        Close();
+        return false;
+    }
+    mappingSize = static_cast<size_t>(size.QuadPart);
+    mappingHandle = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle) mapping = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        mappingSize = static_cast<size_t>(info.st_size);
+        void* view = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) mapping = static_cast<const uint8_t*>(view);
+    }
+    close(fd);
+#endif
+    if (!mapping) {
+        Close();
+        return false;
+    }
+
+    RecordingHeader header;
+    if (mappingSize < sizeof(header)) {
+        Close();
+        return false;
+    }
+    memcpy(&header, mapping, sizeof(header));
+    if (memcmp(header.magic, RECORDING_MAGIC, 8) != 0 || header.headerSize < sizeof(header) ||
+        header.width == 0 || header.height == 0 || header.width > 32768 || header.height > 32768) {
+        Close();
+        return false;
+    }
+    width = static_cast<int>(header.width);
+    height = static_cast<int>(header.height);
+    configUsable = header.configSize == sizeof(DepthIllusionConfig);
+
+    // Index every complete record; anything after the first damaged one is ignored
+    size_t frameBytes = static_cast<size_t>(width) * height * 4;
+    uint64_t position = header.headerSize;
+    while (position + sizeof(RecordHeader) <= mappingSize) {
+        RecordHeader record;
+        memcpy(&record, mapping + position, sizeof(record));
+        uint64_t payloadStart = position + sizeof(RecordHeader);
+        if (record.payloadSize > mappingSize - payloadStart) break;
+
+        if (record.type == RecordHeader::Frame) {
+            uint32_t damageCount = record.damageCount == FULL_DAMAGE ? 0 : record.damageCount;
+            uint64_t pixelStart = AlignUp(payloadStart + damageCount * sizeof(MaskRect), RECORDING_PIXEL_ALIGNMENT);
+            if (pixelStart + frameBytes > payloadStart + record.payloadSize) break;
+
+            FrameEntry entry;
+            entry.pixels = mapping + pixelStart;
+            entry.damage = reinterpret_cast<const MaskRect*>(mapping + payloadStart);
+            entry.damageCount = record.damageCount;
+            entry.timestamp = std::chrono::microseconds(record.timestamp);
+            entry.configIndex = static_cast<int>(configs.size()) - 1;
+            frames.push_back(entry);
+        }
+        else if (record.type == RecordHeader::Config && configUsable && record.payloadSize >= sizeof(DepthIllusionConfig)) {
+            DepthIllusionConfig config;
+            memcpy(&config, mapping + payloadStart, sizeof(config));
+            configs.push_back(config);
+        }
+        position = payloadStart + record.payloadSize;
+    }
+    return true;
+}
+
+bool ReplayFrameSource::NextFrame(FrameView& view) {
+    if (next >= frames.size()) return false;
+
+    const FrameEntry& entry = frames[next];
+    view.pixels = entry.pixels;
+    view.width = width;
+    view.height = height;
+    view.stride = static_cast<size_t>(width) * 4;
+    view.index = next;
+    view.timestamp = entry.timestamp;
+    view.fullDamage = entry.damageCount == FULL_DAMAGE || seeked;
+    seeked = false;
+    if (view.fullDamage) view.damage.clear();
+    else view.damage.assign(entry.damage, entry.damage + entry.damageCount);
+    next++;
+    return true;
+}
+
+void ReplayFrameSource::WarmUp() const {
+    volatile uint8_t sink = 0;
+    for (size_t i = 0; i < mappingSize; i += 4096) sink = sink + mapping[i];
+}
+
+bool ReplayFrameSource::Config(DepthIllusionConfig& config) const {
+    if (configs.empty()) return false;
+    int index = frames.empty() ? 0 : frames[next > 0 ? next - 1 : 0].configIndex;
+    config = configs[std::max(index, 0)];
+    return true;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DepthPipeline.h"
+#include "FrameSource.h"
+
+// Capture recordings: the frames of a live session with their timestamps and damage,
+// plus a snapshot of the settings whenever they changed, in one file. Replaying one
+// gives every optimisation the same real desktop workload.
+//
+// Layout (little endian):
+//   RecordingHeader
+//   records, each a RecordHeader followed by payloadSize bytes:
+//     Config  sizeof(DepthIllusionConfig) bytes; applies to the frames after it
+//     Frame   damageCount MaskRects, zero padding, then height rows of width * 4 BGRA
+//             bytes starting on a 64-byte file offset
+// Records start on 8-byte file offsets; payloadSize includes any padding after them.
+// A recording cut short by a crash stays readable up to its last complete record.
+
+struct RecordingHeader {
+    char magic[8];        // "T3DREC1"
+    uint32_t headerSize;  // sizeof(RecordingHeader)
+    uint32_t width;
+    uint32_t height;
+    uint32_t configSize;  // sizeof(DepthIllusionConfig) of the recording build
+    uint32_t reserved[2];
+};
+
+struct RecordHeader {
+    enum Type : uint32_t { Frame = 1, Config = 2 };
+
+    uint32_t type;
+    uint32_t damageCount;   // Frame: number of damage rectangles; 0xFFFFFFFF for full damage
+    uint64_t payloadSize;
+    int64_t timestamp;      // Frame: microseconds since the first recorded frame
+    uint64_t reserved;
+};
+
+const size_t RECORDING_PIXEL_ALIGNMENT = 64;
+
+// Whether path starts with the recording signature
+bool IsRecordingFile(const std::string& path);
+
+// Writes a recording. Frames are copied into a small pool of buffers and written by a
+// background thread, so a slow disk costs dropped frames rather than a stalled capture.
+// Settings records are queued outside that pool and are never dropped.
+class FrameRecorder {
+public:
+    explicit FrameRecorder(size_t bufferCount = 8) : bufferCount(bufferCount) {}
+    ~FrameRecorder();
+
+    FrameRecorder(const FrameRecorder&) = delete;
+    FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+    bool Open(const std::string& path, int width, int height);
+
+    // Flushes queued records and closes the file; false if any write failed
+    bool Close();
+
+    bool IsOpen() const { return file != nullptr; }
+
+    // Records config as the settings of the frames that follow
+    bool WriteConfig(const DepthIllusionConfig& config);
+
+    // Queues a frame of the recording's size. Timestamps are taken relative to the first
+    // frame. Returns false, and counts a dropped frame, when every buffer is waiting
+    // for the disk.
+    bool WriteFrame(const FrameView& view);
+
+    unsigned long long FramesWritten() const;
+    unsigned long long FramesDropped() const;
+
+private:
+    struct Record {
+        RecordHeader header = {};
+        std::vector<uint8_t> payload;
+    };
+
+    void WriterLoop();
+    bool Enqueue(Record* record);
+
+    size_t bufferCount;
+    FILE* file = nullptr;
+    int width = 0;
+    int height = 0;
+    bool firstFrame = true;
+    bool forceFullDamage = false;  // A frame was dropped, so the next one's damage is incomplete
+    std::chrono::microseconds firstTimestamp{ 0 };
+    uint64_t offset = 0;  // File offset the next queued record starts at
+
+    std::vector<Record> buffers;
+    std::thread writer;
+    mutable std::mutex mutex;
+    std::condition_variable queued;      // A record was queued, or closing
+    std::vector<Record*> freeBuffers;
+    std::deque<Record> configRecords;    // Queued settings, oldest first
+    std::deque<Record*> pending;         // In file order
+    bool closing = false;
+    bool writeFailed = false;
+    unsigned long long framesWritten = 0;
+    unsigned long long framesDropped = 0;
+};
+
+// Plays a recording back from a read-only memory mapping. Views point straight into
+// the mapping, so replaying a frame copies nothing.
+class ReplayFrameSource : public FrameSource {
+public:
+    ReplayFrameSource() = default;
+    ~ReplayFrameSource() override;
+
+    ReplayFrameSource(const ReplayFrameSource&) = delete;
+    ReplayFrameSource& operator=(const ReplayFrameSource&) = delete;
+
+    // Maps the file and indexes its records; false if it is not a readable recording
+    bool Open(const std::string& path);
+
+    bool NextFrame(FrameView& view) override;
+    int Width() const override { return width; }
+    int Height() const override { return height; }
+
+    size_t FrameCount() const { return frames.size(); }
+
+    // Continues playback from frame index. Recorded damage is relative to the frame
+    // before, so the first frame after a jump reports full damage.
+    void Seek(size_t frameIndex) {
+        size_t target = std::min(frameIndex, frames.size());
+        if (target != next) seeked = true;
+        next = target;
+    }
+
+    // Jumps through the frame index; nothing is read
+    unsigned long long Skip(unsigned long long count) override {
+        size_t skipped = static_cast<size_t>(std::min<unsigned long long>(count, frames.size() - next));
+        Seek(next + skipped);
+        return skipped;
+    }
+
+    // Reads every page of the mapping once, so replay measures the pipeline rather than
+    // the disk
+    void WarmUp() const;
+
+    // Settings recorded for the frame last returned by NextFrame (the first recorded
+    // settings before that); false when the recording has none, or they come from a
+    // build with a different DepthIllusionConfig layout
+    bool Config(DepthIllusionConfig& config) const;
+
+private:
+    struct FrameEntry {
+        const uint8_t* pixels;
+        const MaskRect* damage;
+        uint32_t damageCount;
+        std::chrono::microseconds timestamp;
+        int configIndex;  // -1 before the first config record
+    };
+
+    void Close();
+
+    const uint8_t* mapping = nullptr;
+    size_t mappingSize = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+    int width = 0;
+    int height = 0;
+    bool configUsable = false;
+    std::vector<FrameEntry> frames;
+    std::vector<DepthIllusionConfig> configs;
+    size_t next = 0;
+    bool seeked = false;  // The next frame does not follow the one returned last
+};
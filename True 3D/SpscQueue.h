@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+// Bounded single-producer/single-consumer ring buffer.
+// TryPush/TryPop are lock-free; Push/Pop block only when the ring is full/empty,
+// parking the caller on a condition variable instead of spinning.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    bool TryPush(const T& value) {
+        if (!PushNoWake(value)) return false;
+        WakeWaiters();
+        return true;
+    }
+
+    bool TryPop(T& value) {
+        if (!PopNoWake(value)) return false;
+        WakeWaiters();
+        return true;
+    }
+
+    // Blocking variants; return false once stop is raised
+    bool Push(const T& value, const std::atomic<bool>& stop) {
+        if (!WaitFor([&] { return PushNoWake(value); }, stop)) return false;
+        WakeWaiters();
+        return true;
+    }
+
+    bool Pop(T& value, const std::atomic<bool>& stop) {
+        if (!WaitFor([&] { return PopNoWake(value); }, stop)) return false;
+        WakeWaiters();
+        return true;
+    }
+
+    // Wakes blocked callers so they can observe a raised stop flag
+    void WakeAll() {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        waitCv.notify_all();
+    }
+
+private:
+    bool PushNoWake(const T& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+
+        slots[t & (Capacity - 1)] = value;
+        tail.store(t + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    bool PopNoWake(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+
+        value = slots[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    template <typename Op>
+    bool WaitFor(Op op, const std::atomic<bool>& stop) {
+        // Short spin first: the other side is usually only a few microseconds away
+        for (int spin = 0; spin < 64; spin++) {
+            if (op()) return true;
+            if (stop.load(std::memory_order_relaxed)) return false;
+        }
+
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        bool done = false;
+        {
+            std::unique_lock<std::mutex> lock(waitMutex);
+            while (!(done = op()) && !stop.load(std::memory_order_relaxed)) {
+                waitCv.wait_for(lock, std::chrono::milliseconds(50));
+            }
+        }
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+        return done;
+    }
+
+    void WakeWaiters() {
+        if (waiters.load(std::memory_order_seq_cst) == 0) return;
+        std::lock_guard<std::mutex> lock(waitMutex);
+        waitCv.notify_all();
+    }
+
+    std::array<T, Capacity> slots{};
+    alignas(64) std::atomic<size_t> head{ 0 };  // Advanced by the consumer
+    alignas(64) std::atomic<size_t> tail{ 0 };  // Advanced by the producer
+    alignas(64) std::atomic<int> waiters{ 0 };
+    std::mutex waitMutex;
+    std::condition_variable waitCv;
+};
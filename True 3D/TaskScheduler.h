@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Static dependency graph of tasks. The topology is built once and can be run
+// repeatedly; dependency counters are reset at the start of every run.
+class TaskGraph {
+public:
+    using TaskFn = std::function<void()>;
+
+    int AddTask(TaskFn fn) {
+        nodes.emplace_back();
+        nodes.back().fn = std::move(fn);
+        return static_cast<int>(nodes.size()) - 1;
+    }
+
+    // after only becomes runnable once before has finished
+    void AddDependency(int before, int after) {
+        nodes[before].successors.push_back(after);
+        nodes[after].dependencyCount++;
+    }
+
+    size_t Size() const { return nodes.size(); }
+    void Clear() { nodes.clear(); }
+
+private:
+    friend class WorkStealingPool;
+
+    struct Node {
+        TaskFn fn;
+        std::vector<int> successors;
+        int dependencyCount = 0;
+        std::atomic<int> pending{ 0 };
+    };
+
+    std::deque<Node> nodes;
+};
+
+// Fixed set of workers, each owning a task deque. Owners pop their newest task
+// (depth-first along a tile's stage chain), idle workers steal the oldest task
+// from a random victim. Successors released by a finished task go to the
+// worker that finished it.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threadCount = std::thread::hardware_concurrency())
+        : queues(std::max(1u, threadCount)) {
+        for (size_t i = 0; i < queues.size(); i++) {
+            workers.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            shutdown = true;
+        }
+        sleepCv.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t ThreadCount() const { return workers.size(); }
+
+    // Executes every task of the graph and blocks until all have finished.
+    // Only one graph may run at a time.
+    void Run(TaskGraph& graph) {
+        if (graph.nodes.empty()) return;
+
+        activeGraph = &graph;
+        remaining.store(static_cast<int>(graph.nodes.size()));
+        for (auto& node : graph.nodes) {
+            node.pending.store(node.dependencyCount, std::memory_order_relaxed);
+        }
+
+        // Roots are queued in reverse so owners (which pop from the back) start with the
+        // lowest task ids, i.e. the top of the screen for row-major tile graphs
+        size_t next = 0;
+        for (int id = static_cast<int>(graph.nodes.size()) - 1; id >= 0; id--) {
+            if (graph.nodes[id].dependencyCount != 0) continue;
+            Push(next++ % queues.size(), id);
+        }
+
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCv.wait(lock, [&] { return remaining.load() == 0; });
+        activeGraph = nullptr;
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    void Push(size_t worker, int task) {
+        {
+            std::lock_guard<std::mutex> lock(queues[worker].mutex);
+            queues[worker].tasks.push_back(task);
+        }
+        queued.fetch_add(1);
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCv.notify_one();
+    }
+
+    bool PopLocal(size_t worker, int& task) {
+        std::lock_guard<std::mutex> lock(queues[worker].mutex);
+        if (queues[worker].tasks.empty()) return false;
+        task = queues[worker].tasks.back();
+        queues[worker].tasks.pop_back();
+        queued.fetch_sub(1);
+        return true;
+    }
+
+    bool Steal(size_t thief, unsigned& seed, int& task) {
+        size_t count = queues.size();
+        seed = seed * 1664525u + 1013904223u;
+        size_t start = seed % count;
+        for (size_t i = 0; i < count; i++) {
+            size_t victim = (start + i) % count;
+            if (victim == thief) continue;
+
+            std::lock_guard<std::mutex> lock(queues[victim].mutex);
+            if (queues[victim].tasks.empty()) continue;
+            task = queues[victim].tasks.front();
+            queues[victim].tasks.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void Execute(size_t worker, int task) {
+        TaskGraph::Node& node = activeGraph->nodes[task];
+        node.fn();
+
+        for (int successor : node.successors) {
+            if (activeGraph->nodes[successor].pending.fetch_sub(1) == 1) {
+                Push(worker, successor);
+            }
+        }
+
+        if (remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            doneCv.notify_all();
+        }
+    }
+
+    void WorkerLoop(size_t worker) {
+        unsigned seed = static_cast<unsigned>(worker) * 2654435761u + 1;
+
+        while (true) {
+            int task;
+            if (PopLocal(worker, task) || Steal(worker, seed, task)) {
+                Execute(worker, task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCv.wait(lock, [&] { return shutdown || queued.load() > 0; });
+            if (shutdown) return;
+        }
+    }
+
+    std::vector<WorkerQueue> queues;
+    std::vector<std::thread> workers;
+    TaskGraph* activeGraph = nullptr;
+
+    std::atomic<int> queued{ 0 };
+    std::atomic<int> remaining{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+    bool shutdown = false;
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+};
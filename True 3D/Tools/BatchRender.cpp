@@ -0,0 +1,235 @@
+// BatchRender.cpp : Renders the depth illusion over image sequences without a display.
+//
+// Usage: BatchRender [options] <input>...
+// Inputs are image or video files (PPM, PAM, Y4M, raw BGRA), directories (every such
+// file inside, in name order), - for stdin, or a single capture recording. See
+// PrintUsage for the options.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../BatchRenderer.h"
+#include "../FrameSource.h"
+#include "ToolOptions.h"
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "Usage: BatchRender [options] <input>...\n"
+        "  <input>            PPM/PAM/Y4M/raw BGRA file, directory of them, - for stdin, or a\n"
+        "                     capture recording (.t3drec), which brings its own settings\n"
+        "  -o <dir>           Output directory (default: current directory)\n"
+        "  --overlay <fmt>    Overlay output: pam (default, keeps alpha), ppm, raw or none\n"
+        "  --depth <fmt>      Depth map output: pgm (8 bit), f32 (raw floats) or none (default)\n"
+        "  --size <W>x<H>     Frame size of raw BGRA input\n"
+        "  --fps <n>          Frame rate of raw, PPM and PAM input (default 60)\n"
+        "%s"
+        "                     Any of these replaces a recording's settings\n"
+        "  --threads <n>      Worker threads (default: all cores)\n"
+        "  --frames <n>       Stop after n frames\n"
+        "  --start <n>        Render from frame n of the input on; earlier frames are skipped\n"
+        "  --warmup <n>       Analyse the n frames before --start to build up the temporal\n"
+        "                     smoothing history, without writing them\n"
+        "  --load-state <f>   Resume from a checkpoint: continue with the frame it was saved\n"
+        "                     before, with its smoothing history and animation phase\n"
+        "  --save-state <f>   Write a checkpoint after the last frame\n", CONFIG_OPTIONS_USAGE);
+}
+
+static std::string FramePath(const std::string& directory, const char* prefix, unsigned long long index, const char* extension) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s_%06llu.%s", prefix, index, extension);
+    return directory + "/" + name;
+}
+
+static bool WriteOverlay(const std::string& path, const std::string& format, const RenderedFrame& frame) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    size_t count = static_cast<size_t>(frame.width) * frame.height;
+    std::vector<uint8_t> row;
+    bool ok = true;
+    if (format == "raw") {
+        ok = fwrite(frame.overlay, 4, count, file) == count;
+    }
+    else {
+        bool alpha = format == "pam";
+        int channels = alpha ? 4 : 3;
+        if (alpha) {
+            fprintf(file, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", frame.width, frame.height);
+        }
+        else {
+            fprintf(file, "P6\n%d %d\n255\n", frame.width, frame.height);
+        }
+
+        row.resize(static_cast<size_t>(frame.width) * channels);
+        for (int y = 0; y < frame.height && ok; y++) {
+            const uint8_t* in = frame.overlay + static_cast<size_t>(y) * frame.width * 4;
+            for (int x = 0; x < frame.width; x++) {
+                row[x * channels + 0] = in[x * 4 + 2];
+                row[x * channels + 1] = in[x * 4 + 1];
+                row[x * channels + 2] = in[x * 4 + 0];
+                if (alpha) row[x * channels + 3] = in[x * 4 + 3];
+            }
+            ok = fwrite(row.data(), 1, row.size(), file) == row.size();
+        }
+    }
+    return fclose(file) == 0 && ok;
+}
+
+static bool WriteDepth(const std::string& path, const std::string& format, const RenderedFrame& frame) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    bool ok = true;
+    if (format == "f32") {
+        for (const auto& row : *frame.depthMap) {
+            ok = ok && fwrite(row.data(), sizeof(float), row.size(), file) == row.size();
+        }
+    }
+    else {
+        fprintf(file, "P5\n%d %d\n255\n", frame.width, frame.height);
+        std::vector<uint8_t> bytes(frame.width);
+        for (const auto& row : *frame.depthMap) {
+            for (int x = 0; x < frame.width; x++) {
+                bytes[x] = static_cast<uint8_t>(clamp(row[x], 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+            ok = ok && fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        }
+    }
+    return fclose(file) == 0 && ok;
+}
+
+int main(int argc, char** argv) {
+    DepthIllusionConfig config;
+    std::vector<std::string> inputs;
+    std::string outputDirectory = ".";
+    std::string overlayFormat = "pam";
+    std::string depthFormat = "none";
+    int rawWidth = 0, rawHeight = 0;
+    double fps = 60.0;
+    unsigned threads = std::thread::hardware_concurrency();
+    unsigned long long maxFrames = 0;
+    unsigned long long firstFrame = 0;
+    unsigned long long warmupFrames = 0;
+    std::string loadState, saveState;
+    bool configGiven = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool error = false;
+        if (ParseConfigOption(argc, argv, i, config, error)) {
+            if (error) return 2;
+            configGiven = true;
+        }
+        else if (arg == "-h" || arg == "--help") {
+            PrintUsage();
+            return 0;
+        }
+        else if (arg == "-o" && hasValue) outputDirectory = argv[++i];
+        else if (arg == "--overlay" && hasValue) overlayFormat = argv[++i];
+        else if (arg == "--depth" && hasValue) depthFormat = argv[++i];
+        else if (arg == "--fps" && hasValue) fps = atof(argv[++i]);
+        else if (arg == "--threads" && hasValue) threads = static_cast<unsigned>(std::max(1, atoi(argv[++i])));
+        else if (arg == "--frames" && hasValue) maxFrames = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--start" && hasValue) firstFrame = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--warmup" && hasValue) warmupFrames = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--load-state" && hasValue) loadState = argv[++i];
+        else if (arg == "--save-state" && hasValue) saveState = argv[++i];
+        else if (arg == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &rawWidth, &rawHeight) != 2) {
+                fprintf(stderr, "Invalid size '%s'\n", argv[i]);
+                return 2;
+            }
+        }
+        else if (arg == "-" || arg[0] != '-') AddInput(arg, inputs);
+        else {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    bool writeOverlay = overlayFormat != "none";
+    bool writeDepth = depthFormat != "none";
+    if (inputs.empty() || (writeOverlay && overlayFormat != "pam" && overlayFormat != "ppm" && overlayFormat != "raw") ||
+        (writeDepth && depthFormat != "pgm" && depthFormat != "f32") ||
+        (!loadState.empty() && (firstFrame || warmupFrames))) {
+        PrintUsage();
+        return 2;
+    }
+
+    // A recording replays the settings it was captured with; every frame is rendered
+    // with those of its first frame
+    std::unique_ptr<FrameSource> source = OpenInputs(inputs, rawWidth, rawHeight, fps, configGiven ? nullptr : &config);
+    if (!source) return 1;
+
+    unsigned long long framesWritten = 0;  // Sink calls never overlap, and Finish waits for them
+    auto sink = [&](const RenderedFrame& frame) {
+        if (writeOverlay && !WriteOverlay(FramePath(outputDirectory, "overlay", frame.index, overlayFormat.c_str()), overlayFormat, frame)) {
+            fprintf(stderr, "Cannot write overlay %llu to '%s'\n", frame.index, outputDirectory.c_str());
+            return false;
+        }
+        if (writeDepth && !WriteDepth(FramePath(outputDirectory, "depth", frame.index, depthFormat.c_str()), depthFormat, frame)) {
+            fprintf(stderr, "Cannot write depth map %llu to '%s'\n", frame.index, outputDirectory.c_str());
+            return false;
+        }
+        framesWritten++;
+        return true;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    BatchRenderer renderer(config, source->Width(), source->Height(), sink, threads);
+    FrameView view;
+
+    // Frame indices, and so output names, stay those of the whole input. The phase is
+    // accumulated frame by frame exactly as a render from the first frame would.
+    unsigned long long warmupStart = firstFrame - std::min(warmupFrames, firstFrame);
+    if (!loadState.empty()) {
+        if (!renderer.LoadCheckpoint(loadState)) {
+            fprintf(stderr, "Cannot resume from checkpoint '%s'\n", loadState.c_str());
+            return 1;
+        }
+        firstFrame = warmupStart = renderer.FramesSubmitted();
+    }
+    else {
+        float phase = 0.0f;
+        for (unsigned long long i = 0; i < warmupStart; i++) phase += config.phase_speed;
+        renderer.SetPhase(phase);
+    }
+
+    // Frames before the warm-up are skipped without decoding: recordings seek, files are
+    // seeked over frame by frame
+    for (unsigned long long i = source->Skip(warmupStart); i < firstFrame && source->NextFrame(view); i++) {
+        renderer.WarmUp(view);
+    }
+    renderer.SetNextIndex(firstFrame);
+
+    bool ok = true;
+    while ((maxFrames == 0 || renderer.FramesSubmitted() - firstFrame < maxFrames) && source->NextFrame(view)) {
+        if (!renderer.Submit(view)) {
+            ok = false;
+            break;
+        }
+    }
+    // Frames past the end of a partial render are still the last frames' look-ahead
+    if (ok && maxFrames && renderer.FramesSubmitted() - firstFrame == maxFrames) {
+        for (int i = 0; config.temporal_smoothing && i < config.lookahead_frames && source->NextFrame(view); i++) {
+            renderer.WarmUp(view);
+        }
+    }
+    ok = renderer.Finish() && ok;
+    if (ok && !saveState.empty() && !renderer.SaveCheckpoint(saveState)) {
+        fprintf(stderr, "Cannot write checkpoint '%s'\n", saveState.c_str());
+        ok = false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // Counts what reached the output, which is short of what was submitted after a failure
+    fprintf(stderr, "%s%llu frames of %dx%d in %.2f s (%.2f frames/s, %u threads)\n", ok ? "" : "Failed after ",
+        framesWritten, source->Width(), source->Height(), seconds, framesWritten / std::max(seconds, 1e-9), threads);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,534 @@
+// Benchmark.cpp : Times each stage of the depth pipeline on fixed workloads.
+//
+// Usage: Benchmark [options] [recording.t3drec...]
+// Every stage runs on its own, single-threaded, over whole frames: Analyze, then its
+// parts (edge detection, depth estimation, temporal smoothing), blur, compositing and
+// the iridescence colouring. The tile-parallel DepthPipeline is then timed at each
+// thread count. Workloads are deterministic synthetic scenes at the standard screen
+// sizes plus the frames of any capture recordings given, so two builds run the same
+// pixels. Results are JSON, one entry per workload, size and preset.
+//
+// With --counters each stage also gets the hardware events it caused (Linux only):
+// instructions per cycle, and the last-level cache misses that had to go to memory as
+// bytes per pixel and as bandwidth against a STREAM triad measured at startup. A stage
+// near that ceiling is bandwidth-bound; one with low IPC but little traffic is latency-
+// or dependency-bound.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../DepthPipeline.h"
+#include "../FrameSource.h"
+#include "../Recording.h"
+#include "PerfCounters.h"
+#include "ToolOptions.h"
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "Usage: Benchmark [options] [recording.t3drec...]\n"
+        "  -o <file>          Write the JSON results here (default: stdout)\n"
+        "  --sizes <list>     720p, 1080p, 1440p, 4k or WxH, comma separated\n"
+        "                     (default: 720p,1080p,1440p,4k)\n"
+        "  --scenes <list>    text, gradient, photo, scrolling, video, or none\n"
+        "                     (default: text,gradient,photo,scrolling)\n"
+        "  --threads <list>   Thread counts for the pipeline (default: 1, 2, 4... up to all cores)\n"
+        "  --presets <list>   Presets to run; 0 is the settings as given (default: 0)\n"
+        "  --frames <n>       Distinct frames per workload, cycled through (default 8)\n"
+        "  --min-time <s>     Time spent on each measurement (default 0.3)\n"
+        "  --counters         Count hardware events per stage (Linux perf_event_open)\n"
+        "%s"
+        "Recordings are measured at their own size with their recorded settings as\n"
+        "preset 0, unless settings options are given.\n", CONFIG_OPTIONS_USAGE);
+}
+
+// A fixed set of frames the measurements cycle through
+struct Workload {
+    std::string name;
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<uint8_t>> frames;
+    bool hasRecordedConfig = false;
+    DepthIllusionConfig recordedConfig;
+};
+
+struct Timing {
+    double milliseconds = 0.0;  // Median of the iterations
+    double minMilliseconds = 0.0;
+    size_t iterations = 0;
+};
+
+// Iteration times of one stage and the events counted during them
+struct StageSamples {
+    std::vector<double> milliseconds;
+    PerfCounters::Sample counters;
+};
+
+struct StageResult {
+    const char* name;
+    Timing timing;
+    double totalMilliseconds;
+    PerfCounters::Sample counters;
+};
+
+const int CACHE_LINE_BYTES = 64;
+
+struct PipelineResult {
+    unsigned threads;
+    Timing timing;
+    double stageCpuMilliseconds[STAGE_COUNT];
+};
+
+template <typename Fn>
+static double TimeMilliseconds(Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Calls iteration(i), which returns the milliseconds it measured, until minSeconds of
+// measured time and at least three iterations have passed
+template <typename Fn>
+static void Repeat(double minSeconds, Fn iteration) {
+    const size_t minIterations = 3, maxIterations = 10000;
+    double total = 0.0;
+    for (size_t i = 0; i < maxIterations && (i < minIterations || total < minSeconds * 1000.0); i++) {
+        total += iteration(i);
+    }
+}
+
+// Times one iteration of a stage, counting its events when counters is given
+template <typename Fn>
+static double Sample(StageSamples& samples, PerfCounters* counters, Fn fn) {
+    if (counters) counters->Start();
+    double milliseconds = TimeMilliseconds(fn);
+    if (counters) samples.counters += counters->Stop();
+    samples.milliseconds.push_back(milliseconds);
+    return milliseconds;
+}
+
+static Timing Summarise(std::vector<double> samples) {
+    Timing timing;
+    if (samples.empty()) return timing;
+    std::sort(samples.begin(), samples.end());
+    size_t middle = samples.size() / 2;
+    timing.milliseconds = samples.size() % 2 ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2.0;
+    timing.minMilliseconds = samples.front();
+    timing.iterations = samples.size();
+    return timing;
+}
+
+static StageResult Summarise(const char* name, const StageSamples& samples) {
+    double total = 0.0;
+    for (double milliseconds : samples.milliseconds) total += milliseconds;
+    return { name, Summarise(samples.milliseconds), total, samples.counters };
+}
+
+// Single-thread bandwidth of the STREAM triad a = b + s * c over arrays far larger than
+// any last-level cache, best of five passes: the most memory traffic one thread can
+// sustain, which the single-threaded stages are measured against. Counted as STREAM
+// does, three arrays per pass.
+static double TriadBandwidth() {
+    const size_t elements = size_t(32) << 20;
+    std::vector<float> a(elements, 0.0f), b(elements, 1.0f), c(elements, 2.0f);
+    double best = 0.0;
+    for (int pass = 0; pass < 5; pass++) {
+        float scalar = 3.0f + pass;
+        double milliseconds = TimeMilliseconds([&] {
+            for (size_t i = 0; i < elements; i++) a[i] = b[i] + scalar * c[i];
+        });
+        best = std::max(best, 3.0 * elements * sizeof(float) / (milliseconds * 1e6));
+    }
+    volatile float sink = a[elements / 2];
+    (void)sink;
+    return best;
+}
+
+static bool ParseSize(const std::string& name, int& width, int& height) {
+    static const struct { const char* name; int width, height; } sizes[] = {
+        { "720p", 1280, 720 }, { "1080p", 1920, 1080 }, { "1440p", 2560, 1440 },
+        { "4k", 3840, 2160 }, { "2160p", 3840, 2160 },
+    };
+    for (const auto& size : sizes) {
+        if (name == size.name) {
+            width = size.width;
+            height = size.height;
+            return true;
+        }
+    }
+    return sscanf(name.c_str(), "%dx%d", &width, &height) == 2 && width > 4 && height > 4;
+}
+
+static bool ParseScene(const std::string& name, SyntheticScene& scene) {
+    static const struct { const char* name; SyntheticScene scene; } scenes[] = {
+        { "text", SyntheticScene::Text }, { "gradient", SyntheticScene::Gradient },
+        { "photo", SyntheticScene::Photo }, { "scrolling", SyntheticScene::Scrolling },
+        { "video", SyntheticScene::Video },
+    };
+    for (const auto& entry : scenes) {
+        if (name == entry.name) {
+            scene = entry.scene;
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::vector<std::string> SplitList(const std::string& list) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        if (comma > start) items.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
+
+static std::string JsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        }
+        else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+static Workload SyntheticWorkload(const std::string& name, SyntheticScene scene, int width, int height, size_t frameCount) {
+    Workload workload;
+    workload.name = name;
+    workload.width = width;
+    workload.height = height;
+    SyntheticFrameSource source(scene, width, height);
+    FrameView view;
+    while (workload.frames.size() < frameCount && source.NextFrame(view)) {
+        workload.frames.emplace_back(static_cast<size_t>(width) * height * 4);
+        CopyFrame(view, workload.frames.back().data());
+    }
+    return workload;
+}
+
+// The recording's first frameCount frames, copied out so every stage sees the same
+// memory as the synthetic workloads do
+static bool RecordedWorkload(const std::string& path, size_t frameCount, Workload& workload) {
+    ReplayFrameSource replay;
+    if (!replay.Open(path)) return false;
+    size_t slash = path.find_last_of("/\\");
+    workload.name = "recording:" + (slash == std::string::npos ? path : path.substr(slash + 1));
+    workload.width = replay.Width();
+    workload.height = replay.Height();
+    workload.hasRecordedConfig = replay.Config(workload.recordedConfig);
+
+    FrameView view;
+    while (workload.frames.size() < frameCount && replay.NextFrame(view)) {
+        workload.frames.emplace_back(static_cast<size_t>(view.width) * view.height * 4);
+        CopyFrame(view, workload.frames.back().data());
+    }
+    return !workload.frames.empty();
+}
+
+// Times the stages one after another on a single thread, each over the whole frame
+static std::vector<StageResult> MeasureStages(const DepthIllusionConfig& cfg, const Workload& workload, double minSeconds,
+    PerfCounters* counters) {
+    const int width = workload.width, height = workload.height;
+    const size_t frameBytes = static_cast<size_t>(width) * height * 4;
+    auto frame = [&](size_t i) { return workload.frames[i % workload.frames.size()].data(); };
+
+    // A full history, so temporal smoothing blends as many maps as it does in a long run.
+    // Its cost does not depend on the depth values, so empty frames are enough.
+    AdvancedDepthGenerator generator;
+    for (int i = 0; i < cfg.history_frames; i++) {
+        generator.BeginFrame(cfg, width, height);
+        generator.EndFrame();
+    }
+
+    StageSamples analyze, edges, depth, smoothing, blur, composite, iridescence;
+    std::vector<uint8_t> scratch(frameBytes);
+    Repeat(minSeconds, [&](size_t i) {
+        memcpy(scratch.data(), frame(i), frameBytes);
+        return Sample(analyze, counters, [&] { generator.Analyze(cfg, scratch.data(), width, height); });
+    });
+
+    Repeat(minSeconds, [&](size_t i) {
+        generator.BeginFrame(cfg, width, height);
+        double milliseconds = Sample(edges, counters, [&] { generator.DetectEdges(frame(i), 0, 0, width, height); });
+        milliseconds += Sample(depth, counters, [&] { generator.EstimateDepth(0, 0, width, height); });
+        milliseconds += Sample(smoothing, counters, [&] { generator.SmoothDepth(0, 0, width, height); });
+        generator.EndFrame();
+        return milliseconds;
+    });
+
+    const std::vector<std::vector<float>>& depthMap = generator.depthMap;
+    std::vector<uint8_t> blurred(frameBytes), output(frameBytes);
+    // Source to destination as the tile graph blurs, without the frame-sized copy the
+    // in-place ApplyDepthBlur wrapper makes
+    Repeat(minSeconds, [&](size_t i) {
+        return Sample(blur, counters, [&] {
+            ApplyDepthBlurTile(cfg, frame(i), blurred.data(), width, height, depthMap, 0, 0, width, height);
+        });
+    });
+
+    float phase = 0.0f;
+    Repeat(minSeconds, [&](size_t) {
+        double milliseconds = Sample(composite, counters, [&] {
+            CompositeDepthTile(cfg, blurred.data(), output.data(), width, height, depthMap, phase, 0, 0, width, height);
+        });
+        phase += cfg.phase_speed;
+        return milliseconds;
+    });
+
+    Repeat(minSeconds, [&](size_t) {
+        double milliseconds = Sample(iridescence, counters, [&] {
+            for (int y = 0; y < height; y++) {
+                uint8_t* row = output.data() + static_cast<size_t>(y) * width * 4;
+                for (int x = 0; x < width; x++) {
+                    ApplyIridescence(cfg, x, y, depthMap[y][x], phase, row[x * 4 + 2], row[x * 4 + 1], row[x * 4]);
+                }
+            }
+        });
+        phase += cfg.phase_speed;
+        return milliseconds;
+    });
+
+    return {
+        Summarise("analyze", analyze),
+        Summarise("edges", edges),
+        Summarise("depth", depth),
+        Summarise("temporal_smoothing", smoothing),
+        Summarise("blur", blur),
+        Summarise("composite", composite),
+        Summarise("iridescence", iridescence),
+    };
+}
+
+// Times whole frames through the tile task graph
+static PipelineResult MeasurePipeline(const DepthIllusionConfig& cfg, const Workload& workload, unsigned threads,
+    double minSeconds) {
+    DepthPipeline pipeline(workload.width, workload.height, threads);
+    std::vector<uint8_t> output(static_cast<size_t>(workload.width) * workload.height * 4);
+    auto frame = [&](size_t i) { return workload.frames[i % workload.frames.size()].data(); };
+
+    // Fills the history and builds the task graph before anything is timed
+    int warmUp = std::max(2, cfg.temporal_smoothing ? cfg.history_frames : 0);
+    for (int i = 0; i < warmUp; i++) pipeline.Render(cfg, frame(i), output.data());
+
+    PipelineResult result = { threads, Timing(), {} };
+    std::vector<double> samples;
+    Repeat(minSeconds, [&](size_t i) {
+        samples.push_back(TimeMilliseconds([&] { pipeline.Render(cfg, frame(i), output.data()); }));
+        for (int stage = 0; stage < STAGE_COUNT; stage++) result.stageCpuMilliseconds[stage] += pipeline.StageMilliseconds(stage);
+        return samples.back();
+    });
+    result.timing = Summarise(samples);
+    for (double& cpu : result.stageCpuMilliseconds) cpu /= samples.size();
+    return result;
+}
+
+static void WriteTiming(FILE* out, const Timing& timing, double pixels) {
+    fprintf(out, "\"ms\": %.4f, \"min_ms\": %.4f, \"ns_per_pixel\": %.4f, \"frames_per_second\": %.3f, \"iterations\": %zu",
+        timing.milliseconds, timing.minMilliseconds, timing.milliseconds * 1e6 / pixels,
+        1000.0 / std::max(timing.milliseconds, 1e-9), timing.iterations);
+}
+
+// Events per pixel over all iterations of a stage. Memory traffic is estimated as one
+// cache line per last-level miss, which leaves out write-backs of dirty lines.
+static void WriteCounters(FILE* out, const StageResult& stage, double pixels, double peakBandwidth) {
+    const PerfCounters::Sample& counters = stage.counters;
+    double countedPixels = pixels * stage.timing.iterations;
+    auto perPixel = [&](int event) { return counters.counts[event] / countedPixels; };
+
+    fprintf(out, ", \"counters\": { \"cycles_per_pixel\": %.3f", perPixel(PerfCounters::CYCLES));
+    if (counters.available[PerfCounters::INSTRUCTIONS]) {
+        fprintf(out, ", \"instructions_per_pixel\": %.3f, \"ipc\": %.3f", perPixel(PerfCounters::INSTRUCTIONS),
+            static_cast<double>(counters.counts[PerfCounters::INSTRUCTIONS]) /
+            std::max<uint64_t>(1, counters.counts[PerfCounters::CYCLES]));
+    }
+    if (counters.available[PerfCounters::BRANCH_MISSES]) {
+        fprintf(out, ", \"branch_misses_per_pixel\": %.5f", perPixel(PerfCounters::BRANCH_MISSES));
+    }
+    if (counters.available[PerfCounters::LLC_MISSES]) {
+        double bytes = static_cast<double>(counters.counts[PerfCounters::LLC_MISSES]) * CACHE_LINE_BYTES;
+        double bandwidth = bytes / std::max(stage.totalMilliseconds * 1e6, 1e-9);
+        fprintf(out, ", \"llc_misses_per_pixel\": %.5f, \"bytes_per_pixel\": %.3f, \"bandwidth_gb_per_s\": %.3f, "
+            "\"bandwidth_of_peak\": %.4f", perPixel(PerfCounters::LLC_MISSES), bytes / countedPixels, bandwidth,
+            bandwidth / std::max(peakBandwidth, 1e-9));
+    }
+    fprintf(out, " }");
+}
+
+int main(int argc, char** argv) {
+    DepthIllusionConfig config;
+    bool configGiven = false;
+    std::string outputPath = "-";
+    std::string sizeList = "720p,1080p,1440p,4k";
+    std::string sceneList = "text,gradient,photo,scrolling";
+    std::string threadList;
+    std::string presetList = "0";
+    std::vector<std::string> recordings;
+    size_t frameCount = 8;
+    double minSeconds = 0.3;
+    bool countEvents = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool error = false;
+        if (ParseConfigOption(argc, argv, i, config, error)) {
+            if (error) return 2;
+            configGiven = true;
+        }
+        else if (arg == "-h" || arg == "--help") {
+            PrintUsage();
+            return 0;
+        }
+        else if (arg == "-o" && hasValue) outputPath = argv[++i];
+        else if (arg == "--sizes" && hasValue) sizeList = argv[++i];
+        else if (arg == "--scenes" && hasValue) sceneList = argv[++i];
+        else if (arg == "--threads" && hasValue) threadList = argv[++i];
+        else if (arg == "--presets" && hasValue) presetList = argv[++i];
+        else if (arg == "--frames" && hasValue) frameCount = static_cast<size_t>(std::max(1, atoi(argv[++i])));
+        else if (arg == "--min-time" && hasValue) minSeconds = std::max(0.0, atof(argv[++i]));
+        else if (arg == "--counters") countEvents = true;
+        else if (arg[0] != '-') recordings.push_back(arg);
+        else {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    std::vector<std::pair<int, int>> sizes;
+    for (const std::string& name : SplitList(sizeList)) {
+        int width, height;
+        if (!ParseSize(name, width, height)) {
+            fprintf(stderr, "Invalid size '%s'\n", name.c_str());
+            return 2;
+        }
+        sizes.emplace_back(width, height);
+    }
+    std::vector<std::pair<std::string, SyntheticScene>> scenes;
+    for (const std::string& name : SplitList(sceneList == "none" ? "" : sceneList)) {
+        SyntheticScene scene;
+        if (!ParseScene(name, scene)) {
+            fprintf(stderr, "Invalid scene '%s'\n", name.c_str());
+            return 2;
+        }
+        scenes.emplace_back(name, scene);
+    }
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> threadCounts;
+    for (const std::string& count : SplitList(threadList)) threadCounts.push_back(static_cast<unsigned>(std::max(1, atoi(count.c_str()))));
+    if (threadCounts.empty()) {
+        for (unsigned count = 1; count < cores; count *= 2) threadCounts.push_back(count);
+        threadCounts.push_back(cores);
+    }
+    std::vector<int> presets;
+    for (const std::string& preset : SplitList(presetList)) presets.push_back(atoi(preset.c_str()));
+
+    // The stages run on this thread, so counting its events covers them
+    PerfCounters counters;
+    double peakBandwidth = 0.0;
+    if (countEvents) {
+        if (counters.Open()) {
+            peakBandwidth = TriadBandwidth();
+            fprintf(stderr, "STREAM triad: %.2f GB/s\n", peakBandwidth);
+        }
+        else {
+            fprintf(stderr, "Hardware counters unavailable (no hardware PMU, or perf_event_paranoid above 2); timing only\n");
+        }
+    }
+
+    FILE* out = outputPath == "-" ? stdout : fopen(outputPath.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Cannot write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    // Workloads are built one at a time; a 4K workload holds a few hundred megabytes
+    std::vector<std::pair<std::string, std::pair<int, int>>> plan;
+    for (const auto& scene : scenes) {
+        for (const auto& size : sizes) plan.emplace_back(scene.first, size);
+    }
+    for (const std::string& recording : recordings) plan.emplace_back(recording, std::make_pair(0, 0));
+
+    fprintf(out, "{\n  \"tool\": \"Benchmark\",\n  \"hardware_threads\": %u,\n  \"min_time_seconds\": %.3f,\n"
+        "  \"frames_per_workload\": %zu,\n", cores, minSeconds, frameCount);
+    if (counters.IsOpen()) fprintf(out, "  \"stream_triad_gb_per_s\": %.3f,\n", peakBandwidth);
+    fprintf(out, "  \"results\": [");
+    bool ok = true;
+    bool first = true;
+    for (size_t entry = 0; entry < plan.size(); entry++) {
+        Workload workload;
+        bool recorded = entry >= scenes.size() * sizes.size();
+        if (recorded) {
+            if (!RecordedWorkload(plan[entry].first, frameCount, workload)) {
+                fprintf(stderr, "Cannot read recording '%s'\n", plan[entry].first.c_str());
+                ok = false;
+                continue;
+            }
+        }
+        else {
+            SyntheticScene scene = SyntheticScene::Text;
+            ParseScene(plan[entry].first, scene);
+            workload = SyntheticWorkload(plan[entry].first, scene, plan[entry].second.first, plan[entry].second.second, frameCount);
+        }
+        double pixels = static_cast<double>(workload.width) * workload.height;
+
+        for (int preset : presets) {
+            DepthIllusionConfig base = recorded && workload.hasRecordedConfig && !configGiven ? workload.recordedConfig : config;
+            DepthIllusionConfig cfg = CreatePreset(preset, base);
+            fprintf(stderr, "%s %dx%d preset %d\n", workload.name.c_str(), workload.width, workload.height, preset);
+
+            std::vector<StageResult> stages = MeasureStages(cfg, workload, minSeconds,
+                counters.IsOpen() ? &counters : nullptr);
+            std::vector<PipelineResult> pipeline;
+            for (unsigned threads : threadCounts) pipeline.push_back(MeasurePipeline(cfg, workload, threads, minSeconds));
+
+            fprintf(out, "%s\n    {\n      \"workload\": %s,\n      \"width\": %d,\n      \"height\": %d,\n"
+                "      \"preset\": %d,\n      \"stages\": {", first ? "" : ",", JsonString(workload.name).c_str(),
+                workload.width, workload.height, preset);
+            first = false;
+            for (size_t i = 0; i < stages.size(); i++) {
+                fprintf(out, "%s\n        \"%s\": { ", i ? "," : "", stages[i].name);
+                WriteTiming(out, stages[i].timing, pixels);
+                if (stages[i].counters.available[PerfCounters::CYCLES]) WriteCounters(out, stages[i], pixels, peakBandwidth);
+                fprintf(out, " }");
+            }
+
+            // Efficiency is relative to perfect scaling from the smallest thread count run
+            static const char* stageNames[STAGE_COUNT] = { "edges", "depth", "smoothing", "blur", "composite" };
+            const PipelineResult& baseline = *std::min_element(pipeline.begin(), pipeline.end(),
+                [](const PipelineResult& a, const PipelineResult& b) { return a.threads < b.threads; });
+            fprintf(out, "\n      },\n      \"pipeline\": [");
+            for (size_t i = 0; i < pipeline.size(); i++) {
+                const PipelineResult& run = pipeline[i];
+                double speedup = baseline.timing.milliseconds / std::max(run.timing.milliseconds, 1e-9);
+                fprintf(out, "%s\n        { \"threads\": %u, ", i ? "," : "", run.threads);
+                WriteTiming(out, run.timing, pixels);
+                fprintf(out, ", \"scaling_efficiency\": %.4f, \"stage_cpu_ms\": {",
+                    speedup * baseline.threads / run.threads);
+                for (int stage = 0; stage < STAGE_COUNT; stage++) {
+                    fprintf(out, "%s \"%s\": %.4f", stage ? "," : "", stageNames[stage], run.stageCpuMilliseconds[stage]);
+                }
+                fprintf(out, " } }");
+            }
+            fprintf(out, "\n      ]\n    }");
+            fflush(out);
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout) ok = fclose(out) == 0 && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware event counts of the calling thread, from Linux perf_event_open. The events
+// form one group so they are always scheduled together; when the PMU has to multiplex
+// them, counts are scaled up to the time the group was enabled. Events the CPU (or
+// hypervisor) lacks are left out; elsewhere than Linux nothing opens.
+class PerfCounters {
+public:
+    enum Event { CYCLES, INSTRUCTIONS, LLC_MISSES, BRANCH_MISSES, EVENT_COUNT };
+
+    // Counts since Start; an event that could not be opened reads as unavailable
+    struct Sample {
+        uint64_t counts[EVENT_COUNT] = {};
+        bool available[EVENT_COUNT] = {};
+
+        Sample& operator+=(const Sample& other) {
+            for (int event = 0; event < EVENT_COUNT; event++) {
+                counts[event] += other.counts[event];
+                available[event] = other.available[event];
+            }
+            return *this;
+        }
+    };
+
+    PerfCounters() = default;
+    ~PerfCounters() { Close(); }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // User-space events of this thread only, which perf_event_paranoid 2 still allows.
+    // False if not even the cycle counter opens.
+    bool Open() {
+#ifdef __linux__
+        static const uint64_t configs[EVENT_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+        };
+        Close();
+        for (int event = 0; event < EVENT_COUNT; event++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[event];
+            attr.disabled = event == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, event == 0 ? -1 : fds[CYCLES], 0));
+            if (fd < 0 && event == 0) return false;
+            fds[event] = fd;
+            if (fd >= 0) groupOrder[groupSize++] = event;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool IsOpen() const { return fds[CYCLES] >= 0; }
+
+    void Start() {
+#ifdef __linux__
+        if (!IsOpen()) return;
+        ioctl(fds[CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    Sample Stop() {
+        Sample sample;
+#ifdef __linux__
+        if (!IsOpen()) return sample;
+        ioctl(fds[CYCLES], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // nr, time enabled, time running, then one value per event in group order
+        uint64_t values[3 + EVENT_COUNT] = {};
+        if (read(fds[CYCLES], values, sizeof(values)) < static_cast<ssize_t>(3 * sizeof(uint64_t))) return sample;
+        double scale = values[2] > 0 ? static_cast<double>(values[1]) / values[2] : 0.0;
+        for (uint64_t i = 0; i < values[0] && i < static_cast<uint64_t>(groupSize); i++) {
+            int event = groupOrder[i];
+            sample.counts[event] = static_cast<uint64_t>(values[3 + i] * scale + 0.5);
+            sample.available[event] = values[2] > 0;
+        }
+#endif
+        return sample;
+    }
+
+private:
+    void Close() {
+#ifdef __linux__
+        for (int& fd : fds) {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+#endif
+        groupSize = 0;
+    }
+
+    int fds[EVENT_COUNT] = { -1, -1, -1, -1 };
+    int groupOrder[EVENT_COUNT] = {};  // Event of each group member, leader first
+    int groupSize = 0;
+};
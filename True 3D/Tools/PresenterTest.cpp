@@ -0,0 +1,154 @@
+// PresenterTest.cpp : Checks DirtyRectTracker against MockPresenter without a display.
+//
+// Usage: PresenterTest
+// Feeds pairs of synthetic frames through the tracker and rebuilds each frame in a
+// MockPresenter from the reported rectangles alone. A case passes when the rebuilt frame
+// equals the input and the rectangles are the expected ones. Exits non-zero on failure.
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../Presenter.h"
+
+struct TestFrame {
+    int width, height;
+    std::vector<uint8_t> pixels;
+
+    TestFrame(int width, int height) : width(width), height(height), pixels(static_cast<size_t>(width) * height * 4) {
+        for (size_t i = 0; i < pixels.size(); i++) pixels[i] = static_cast<uint8_t>(i * 7 + i / 4 * 13);
+    }
+
+    void Touch(int x, int y) { pixels[(static_cast<size_t>(y) * width + x) * 4 + 1] ^= 0x5a; }
+
+    void Fill(const MaskRect& r) {
+        for (int y = r.top; y < r.bottom; y++) {
+            for (int x = r.left; x < r.right; x++) Touch(x, y);
+        }
+    }
+};
+
+static int failures = 0;
+
+static std::string Describe(const std::vector<MaskRect>& rects) {
+    std::string text;
+    for (const MaskRect& r : rects) {
+        char item[64];
+        snprintf(item, sizeof(item), " (%d,%d)-(%d,%d)", r.left, r.top, r.right, r.bottom);
+        text += item;
+    }
+    return text.empty() ? " none" : text;
+}
+
+// Presents frame and checks the rebuilt frame and the rectangles the tracker reported
+static void Check(const char* name, DirtyRectTracker& tracker, MockPresenter& presenter, const TestFrame& frame,
+    const std::vector<MaskRect>& expected) {
+    const std::vector<MaskRect>& dirty = tracker.Update(frame.pixels.data(), frame.width, frame.height);
+    presenter.Present(frame.pixels.data(), frame.width, frame.height, dirty);
+
+    bool sameRects = dirty.size() == expected.size();
+    for (size_t i = 0; sameRects && i < dirty.size(); i++) {
+        sameRects = dirty[i].left == expected[i].left && dirty[i].top == expected[i].top &&
+            dirty[i].right == expected[i].right && dirty[i].bottom == expected[i].bottom;
+    }
+    bool matches = presenter.Matches(frame.pixels.data());
+
+    printf("%-4s %s\n", sameRects && matches ? "ok" : "FAIL", name);
+    if (!sameRects) printf("     rects%s, expected%s\n", Describe(dirty).c_str(), Describe(expected).c_str());
+    if (!matches) printf("     rebuilt frame differs from the input\n");
+    if (!sameRects || !matches) failures++;
+}
+
+int main() {
+    const int cell = 64;
+
+    {
+        DirtyRectTracker tracker(cell);
+        MockPresenter presenter;
+        TestFrame frame(256, 192);
+        Check("first frame is dirty as a whole", tracker, presenter, frame, { { 0, 0, 256, 192 } });
+        Check("no damage", tracker, presenter, frame, {});
+
+        frame.Touch(70, 10);
+        Check("single pixel dirties its cell", tracker, presenter, frame, { { 64, 0, 128, 64 } });
+
+        frame.Fill({ 10, 10, 20, 20 });
+        frame.Fill({ 140, 140, 150, 150 });
+        Check("separate cells stay separate", tracker, presenter, frame, { { 0, 0, 64, 64 }, { 128, 128, 192, 192 } });
+
+        frame.Fill({ 60, 60, 70, 70 });
+        Check("2x2 cell block merges", tracker, presenter, frame, { { 0, 0, 128, 128 } });
+
+        frame.Fill({ 200, 0, 201, 192 });
+        Check("column merges down", tracker, presenter, frame, { { 192, 0, 256, 192 } });
+
+        frame.Fill({ 0, 100, 256, 101 });
+        Check("row merges across", tracker, presenter, frame, { { 0, 64, 256, 128 } });
+    }
+
+    {
+        // Four rectangles at most: a checkerboard of dirty cells falls back to its bounds
+        DirtyRectTracker tracker(cell, 4);
+        MockPresenter presenter;
+        TestFrame frame(320, 256);
+        Check("first frame", tracker, presenter, frame, { { 0, 0, 320, 256 } });
+
+        for (int cy = 0; cy < 4; cy++) {
+            for (int cx = (cy & 1); cx < 4; cx += 2) frame.Touch(cx * cell + 5, cy * cell + 5);
+        }
+        Check("too many rects fall back to their bounds", tracker, presenter, frame, { { 0, 0, 256, 256 } });
+
+        TestFrame resized(160, 96);
+        Check("size change is fully dirty", tracker, presenter, resized, { { 0, 0, 160, 96 } });
+
+        tracker.Reset();
+        Check("reset is fully dirty", tracker, presenter, resized, { { 0, 0, 160, 96 } });
+    }
+
+    {
+        // 200 x 130 leaves a partial column (192-200) and row (128-130) of cells
+        DirtyRectTracker tracker(cell);
+        MockPresenter presenter;
+        TestFrame frame(200, 130);
+        Check("odd-sized first frame", tracker, presenter, frame, { { 0, 0, 200, 130 } });
+
+        frame.Touch(199, 129);
+        Check("odd-sized tail corner", tracker, presenter, frame, { { 192, 128, 200, 130 } });
+
+        frame.Touch(195, 5);
+        frame.Touch(195, 70);
+        Check("odd-sized tail column", tracker, presenter, frame, { { 192, 0, 200, 128 } });
+
+        frame.Fill({ 0, 129, 200, 130 });
+        Check("odd-sized tail row", tracker, presenter, frame, { { 0, 128, 200, 130 } });
+    }
+
+    {
+        // Random damage: whatever the rectangles are, they must rebuild every frame
+        DirtyRectTracker tracker(16, 8);
+        MockPresenter presenter;
+        TestFrame frame(173, 91);
+        std::mt19937 rng(1234);
+        tracker.Update(frame.pixels.data(), frame.width, frame.height);
+        presenter.Present(frame.pixels.data(), frame.width, frame.height, { { 0, 0, frame.width, frame.height } });
+
+        int mismatches = 0;
+        for (int i = 0; i < 500; i++) {
+            int touches = static_cast<int>(rng() % 12);
+            for (int t = 0; t < touches; t++) frame.Touch(static_cast<int>(rng() % frame.width), static_cast<int>(rng() % frame.height));
+            presenter.Present(frame.pixels.data(), frame.width, frame.height,
+                tracker.Update(frame.pixels.data(), frame.width, frame.height));
+            if (!presenter.Matches(frame.pixels.data())) mismatches++;
+        }
+        printf("%-4s random damage over 500 frames\n", mismatches ? "FAIL" : "ok");
+        if (mismatches) {
+            printf("     %d frames differ\n", mismatches);
+            failures++;
+        }
+    }
+
+    printf(failures ? "%d failed\n" : "all passed\n", failures);
+    return failures ? 1 : 0;
+}
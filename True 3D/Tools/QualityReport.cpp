@@ -0,0 +1,463 @@
+// QualityReport.cpp : What each fast mode costs in fidelity, and what it saves in time.
+//
+// Usage: QualityReport [options] [input...]
+// Renders one fixed workload with every combination of the quality modes (edge kernel,
+// interlaced analysis, flat-tile skipping, depth blur, temporal smoothing, composite
+// scale, foveation, iridescence) and compares each against the full-quality reference: PSNR and SSIM of the image as
+// the overlay window shows it, and the mean absolute error of the depth map. The
+// combinations no faster one beats on the chosen metric form the Pareto front, which
+// is what quality tiers should be picked from. Live combinations are timed as the latency
+// of one serial render and look-ahead ones as the batch renderer's throughput, so each
+// kind gets its own front.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../BatchRenderer.h"
+#include "../DepthPipeline.h"
+#include "../FrameSource.h"
+#include "ToolOptions.h"
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "Usage: QualityReport [options] [input...]\n"
+        "  Input is a capture recording or image sequence (see BatchRender); without one a\n"
+        "  synthetic scene is used.\n"
+        "  --scene <name>     text, gradient, photo, scrolling (default) or video\n"
+        "  --size <W>x<H>     Synthetic scene size, or size of raw input (default 640x360)\n"
+        "  --frames <n>       Frames measured (default 40)\n"
+        "  --warmup <n>       Frames rendered first and left out of every measurement (default 10)\n"
+        "  --threads <n>      Worker threads (default: all cores)\n"
+        "  --metric <m>       Quality the front is built on: psnr (default), ssim or depth\n"
+        "  --all              List every combination, marking the front with *\n"
+        "  --csv <file>       Also write every combination as CSV\n"
+        "%s"
+        "The reference is the given settings at full quality. Live combinations are timed\n"
+        "as per-frame latency, look-ahead ones as offline throughput; each has its own front.\n",
+        CONFIG_OPTIONS_USAGE);
+}
+
+// One setting of one quality knob; the first mode of each axis is full quality
+struct Mode {
+    const char* name;
+    std::function<void(DepthIllusionConfig&)> apply;
+};
+
+struct Axis {
+    const char* name;
+    std::vector<Mode> modes;
+};
+
+struct Workload {
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<uint8_t>> frames;  // warm-up frames first
+};
+
+// What a run produced for each measured frame, at full resolution
+struct RunOutput {
+    double millisecondsPerFrame = 0.0;
+    std::vector<std::vector<uint8_t>> displayed;
+    std::vector<std::vector<float>> depth;
+};
+
+struct Result {
+    std::vector<int> modes;  // Index into each axis
+    double millisecondsPerFrame = 0.0;
+    double psnr = 0.0;
+    double ssim = 0.0;
+    double depthError = 0.0;
+    bool offline = false;    // Timed as batch throughput rather than live latency
+    bool front = false;
+};
+
+static void StoreFrame(RunOutput& run, const Workload& workload, size_t frame, const uint8_t* overlay,
+    const std::vector<std::vector<float>>& depthMap) {
+    size_t pixels = static_cast<size_t>(workload.width) * workload.height;
+    std::vector<uint8_t> displayed(pixels * 4);
+    BlendOverlay(overlay, workload.frames[frame].data(), displayed.data(), pixels);
+    run.displayed.push_back(std::move(displayed));
+
+    std::vector<float> depth;
+    depth.reserve(pixels);
+    for (const auto& row : depthMap) depth.insert(depth.end(), row.begin(), row.end());
+    run.depth.push_back(std::move(depth));
+}
+
+// The live pipeline: every mode except look-ahead smoothing. A reduced composite is
+// upscaled to full size the way the overlay window does it.
+static RunOutput RenderLive(const DepthIllusionConfig& cfg, const Workload& workload, size_t warmup, unsigned threads) {
+    RunOutput run;
+    DepthPipeline pipeline(workload.width, workload.height, threads);
+    pipeline.SetFocusPoint(workload.width / 2, workload.height / 2);  // Foveated modes look at the centre
+    BilinearUpscaler upscaler;
+    std::vector<uint8_t> output(static_cast<size_t>(workload.width) * workload.height * 4);
+    std::vector<uint8_t> upscaled(output.size());
+
+    double measured = 0.0;
+    for (size_t i = 0; i < workload.frames.size(); i++) {
+        auto start = std::chrono::steady_clock::now();
+        pipeline.Render(cfg, workload.frames[i].data(), output.data());
+        const uint8_t* overlay = output.data();
+        if (pipeline.OutputWidth() != workload.width || pipeline.OutputHeight() != workload.height) {
+            upscaler.Upscale(output.data(), pipeline.OutputWidth(), pipeline.OutputHeight(), upscaled.data(),
+                workload.width, workload.height);
+            overlay = upscaled.data();
+        }
+        if (i < warmup) continue;
+        measured += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        StoreFrame(run, workload, i, overlay, pipeline.DepthMap());
+    }
+    run.millisecondsPerFrame = measured / std::max<size_t>(1, workload.frames.size() - warmup);
+    return run;
+}
+
+// Look-ahead smoothing only exists offline. Frames are composited in parallel behind the
+// analysis, so the time is the whole render's divided by its frames.
+static RunOutput RenderOffline(const DepthIllusionConfig& cfg, const Workload& workload, size_t warmup, unsigned threads) {
+    RunOutput run;
+    BatchRenderer renderer(cfg, workload.width, workload.height, [&](const RenderedFrame& frame) {
+        StoreFrame(run, workload, warmup + static_cast<size_t>(frame.index), frame.overlay, *frame.depthMap);
+        return true;
+    }, threads);
+
+    FrameView view;
+    view.width = workload.width;
+    view.height = workload.height;
+    view.stride = static_cast<size_t>(workload.width) * 4;
+    for (size_t i = 0; i < warmup; i++) {
+        view.pixels = workload.frames[i].data();
+        renderer.WarmUp(view);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = warmup; i < workload.frames.size(); i++) {
+        view.pixels = workload.frames[i].data();
+        view.index = i - warmup;
+        renderer.Submit(view);
+    }
+    renderer.Finish();
+    double measured = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    run.millisecondsPerFrame = measured / std::max<size_t>(1, workload.frames.size() - warmup);
+    return run;
+}
+
+static void Luma(const uint8_t* bgra, size_t pixels, std::vector<float>& luma) {
+    luma.resize(pixels);
+    for (size_t i = 0; i < pixels; i++) {
+        luma[i] = 0.299f * bgra[i * 4 + 2] + 0.587f * bgra[i * 4 + 1] + 0.114f * bgra[i * 4];
+    }
+}
+
+// Mean SSIM of the luma of two images over 8x8 windows placed every 4 pixels
+static double Ssim(const std::vector<float>& a, const std::vector<float>& b, int width, int height) {
+    const int window = 8, stride = 4;
+    const double c1 = (0.01 * 255) * (0.01 * 255), c2 = (0.03 * 255) * (0.03 * 255);
+    const double n = window * window;
+    double total = 0.0;
+    int count = 0;
+    for (int y0 = 0; y0 + window <= height; y0 += stride) {
+        for (int x0 = 0; x0 + window <= width; x0 += stride) {
+            double sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+            for (int y = y0; y < y0 + window; y++) {
+                for (int x = x0; x < x0 + window; x++) {
+                    double va = a[static_cast<size_t>(y) * width + x], vb = b[static_cast<size_t>(y) * width + x];
+                    sumA += va;
+                    sumB += vb;
+                    sumAA += va * va;
+                    sumBB += vb * vb;
+                    sumAB += va * vb;
+                }
+            }
+            double meanA = sumA / n, meanB = sumB / n;
+            double varA = sumAA / n - meanA * meanA, varB = sumBB / n - meanB * meanB;
+            double covariance = sumAB / n - meanA * meanB;
+            total += (2 * meanA * meanB + c1) * (2 * covariance + c2) /
+                ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+            count++;
+        }
+    }
+    return count ? total / count : 1.0;
+}
+
+static void Compare(const RunOutput& run, const RunOutput& reference, int width, int height, Result& result) {
+    size_t pixels = static_cast<size_t>(width) * height;
+    double squaredError = 0.0, ssim = 0.0, depthError = 0.0;
+    std::vector<float> lumaA, lumaB;
+    for (size_t frame = 0; frame < reference.displayed.size(); frame++) {
+        const uint8_t* a = run.displayed[frame].data();
+        const uint8_t* b = reference.displayed[frame].data();
+        for (size_t i = 0; i < pixels * 4; i++) {
+            if ((i & 3) == 3) continue;
+            double difference = static_cast<double>(a[i]) - b[i];
+            squaredError += difference * difference;
+        }
+        Luma(a, pixels, lumaA);
+        Luma(b, pixels, lumaB);
+        ssim += Ssim(lumaA, lumaB, width, height);
+        for (size_t i = 0; i < pixels; i++) depthError += std::abs(run.depth[frame][i] - reference.depth[frame][i]);
+    }
+
+    size_t frames = std::max<size_t>(1, reference.displayed.size());
+    double mse = squaredError / (static_cast<double>(frames) * pixels * 3);
+    result.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+    result.ssim = ssim / frames;
+    result.depthError = depthError / (static_cast<double>(frames) * pixels);
+}
+
+static double Quality(const Result& result, const std::string& metric) {
+    if (metric == "ssim") return result.ssim;
+    if (metric == "depth") return -result.depthError;
+    return result.psnr;
+}
+
+// A combination is on the front if every faster one of the same kind has lower quality
+static void MarkFront(std::vector<Result>& results, const std::string& metric, bool offline) {
+    std::vector<Result*> order;
+    for (Result& result : results) {
+        if (result.offline == offline) order.push_back(&result);
+    }
+    std::sort(order.begin(), order.end(), [&](const Result* a, const Result* b) {
+        if (a->millisecondsPerFrame != b->millisecondsPerFrame) return a->millisecondsPerFrame < b->millisecondsPerFrame;
+        return Quality(*a, metric) > Quality(*b, metric);
+    });
+    double best = -std::numeric_limits<double>::infinity();
+    for (Result* result : order) {
+        result->front = Quality(*result, metric) > best;
+        best = std::max(best, Quality(*result, metric));
+    }
+}
+
+int main(int argc, char** argv) {
+    DepthIllusionConfig config;
+    bool configGiven = false;
+    std::vector<std::string> inputs;
+    std::string sceneName = "scrolling";
+    std::string metric = "psnr";
+    std::string csvPath;
+    int width = 640, height = 360;
+    bool sizeGiven = false;
+    size_t frameCount = 40, warmup = 10;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool listAll = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool error = false;
+        if (ParseConfigOption(argc, argv, i, config, error)) {
+            if (error) return 2;
+            configGiven = true;
+        }
+        else if (arg == "-h" || arg == "--help") {
+            PrintUsage();
+            return 0;
+        }
+        else if (arg == "--scene" && hasValue) sceneName = argv[++i];
+        else if (arg == "--frames" && hasValue) frameCount = static_cast<size_t>(std::max(1, atoi(argv[++i])));
+        else if (arg == "--warmup" && hasValue) warmup = static_cast<size_t>(std::max(0, atoi(argv[++i])));
+        else if (arg == "--threads" && hasValue) threads = static_cast<unsigned>(std::max(1, atoi(argv[++i])));
+        else if (arg == "--metric" && hasValue) metric = argv[++i];
+        else if (arg == "--csv" && hasValue) csvPath = argv[++i];
+        else if (arg == "--all") listAll = true;
+        else if (arg == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 4 || height <= 4) {
+                fprintf(stderr, "Invalid size '%s'\n", argv[i]);
+                return 2;
+            }
+            sizeGiven = true;
+        }
+        else if (arg[0] != '-') AddInput(arg, inputs);
+        else {
+            PrintUsage();
+            return 2;
+        }
+    }
+    if (metric != "psnr" && metric != "ssim" && metric != "depth") {
+        PrintUsage();
+        return 2;
+    }
+
+    static const struct { const char* name; SyntheticScene scene; } scenes[] = {
+        { "text", SyntheticScene::Text }, { "gradient", SyntheticScene::Gradient },
+        { "photo", SyntheticScene::Photo }, { "scrolling", SyntheticScene::Scrolling },
+        { "video", SyntheticScene::Video },
+    };
+    std::unique_ptr<FrameSource> source;
+    if (inputs.empty()) {
+        for (const auto& scene : scenes) {
+            if (sceneName == scene.name) source.reset(new SyntheticFrameSource(scene.scene, width, height));
+        }
+        if (!source) {
+            fprintf(stderr, "Invalid scene '%s'\n", sceneName.c_str());
+            return 2;
+        }
+    }
+    else {
+        source = OpenInputs(inputs, sizeGiven ? width : 0, sizeGiven ? height : 0, 60.0, configGiven ? nullptr : &config);
+        if (!source) return 1;
+    }
+
+    Workload workload;
+    workload.width = source->Width();
+    workload.height = source->Height();
+    FrameView view;
+    while (workload.frames.size() < warmup + frameCount && source->NextFrame(view)) {
+        if (view.width != workload.width || view.height != workload.height) break;
+        workload.frames.emplace_back(static_cast<size_t>(view.width) * view.height * 4);
+        CopyFrame(view, workload.frames.back().data());
+    }
+    source.reset();
+    if (workload.frames.size() <= warmup) {
+        fprintf(stderr, "Need more than %zu frames of input\n", warmup);
+        return 1;
+    }
+
+    // The reference: the given settings with every quality knob at full
+    DepthIllusionConfig reference = config;
+    reference.edge_kernel_mode = 0;
+    reference.interlace_frames = 1;
+    reference.flat_threshold = -1;
+    reference.render_scale = 1.0f;
+    reference.foveated = false;
+    reference.lookahead_frames = 0;
+    const int history = std::max(1, config.history_frames);
+    const int lookahead = config.lookahead_frames > 0 ? config.lookahead_frames : std::max(1, history / 4);
+
+    const std::vector<Axis> axes = {
+        { "edges", {
+            { "5x5", [](DepthIllusionConfig&) {} },
+            { "3x3", [](DepthIllusionConfig& c) { c.edge_kernel_mode = 1; } } } },
+        { "analysis", {
+            { "full", [](DepthIllusionConfig&) {} },
+            { "interlace2", [](DepthIllusionConfig& c) { c.interlace_frames = 2; } },
+            { "interlace4", [](DepthIllusionConfig& c) { c.interlace_frames = 4; } } } },
+        { "flat", {
+            { "off", [](DepthIllusionConfig&) {} },
+            { "skip", [](DepthIllusionConfig& c) { c.flat_threshold = FAST_FLAT_THRESHOLD; } } } },
+        { "blur", {
+            { "full", [](DepthIllusionConfig&) {} },
+            { "off", [](DepthIllusionConfig& c) { c.blur_radius = 0.0f; } } } },
+        { "smoothing", {
+            { "causal", [](DepthIllusionConfig&) {} },
+            { "short", [=](DepthIllusionConfig& c) { c.history_frames = std::max(1, history / 4); } },
+            { "off", [](DepthIllusionConfig& c) { c.temporal_smoothing = false; } },
+            { "lookahead", [=](DepthIllusionConfig& c) {
+                c.temporal_smoothing = true;
+                c.lookahead_frames = lookahead;
+            } } } },
+        { "scale", {
+            { "full", [](DepthIllusionConfig&) {} },
+            { "half", [](DepthIllusionConfig& c) { c.render_scale = 0.5f; } } } },
+        { "foveated", {
+            { "off", [](DepthIllusionConfig&) {} },
+            { "on", [](DepthIllusionConfig& c) { c.foveated = true; } } } },
+        { "iridescence", {
+            { "on", [](DepthIllusionConfig&) {} },
+            { "off", [](DepthIllusionConfig& c) { c.enable_iridescence = false; } } } },
+    };
+    const size_t analysisAxis = 1, smoothingAxis = 4, scaleAxis = 5, foveatedAxis = 6, lookaheadMode = 3;
+
+    std::vector<std::vector<int>> combinations(1, std::vector<int>(axes.size(), 0));
+    for (size_t axis = 0; axis < axes.size(); axis++) {
+        std::vector<std::vector<int>> expanded;
+        for (const auto& combination : combinations) {
+            for (size_t mode = 0; mode < axes[axis].modes.size(); mode++) {
+                expanded.push_back(combination);
+                expanded.back()[axis] = static_cast<int>(mode);
+            }
+        }
+        combinations.swap(expanded);
+    }
+
+    size_t measured = workload.frames.size() - warmup;
+    fprintf(stderr, "%dx%d, %zu frames after %zu of warm-up, %u threads\n", workload.width, workload.height,
+        measured, warmup, threads);
+    RunOutput referenceRun = RenderLive(reference, workload, warmup, threads);
+    // Offline speedups are relative to the reference settings through the same renderer
+    double offlineReferenceMs = 0.0;
+
+    std::vector<Result> results;
+    for (const auto& combination : combinations) {
+        // The offline renderer analyses and composites every frame in full
+        bool offline = combination[smoothingAxis] == static_cast<int>(lookaheadMode);
+        if (offline && (combination[analysisAxis] != 0 || combination[scaleAxis] != 0 || combination[foveatedAxis] != 0)) {
+            continue;
+        }
+
+        DepthIllusionConfig cfg = reference;
+        std::string label;
+        for (size_t axis = 0; axis < axes.size(); axis++) {
+            const Mode& mode = axes[axis].modes[combination[axis]];
+            mode.apply(cfg);
+            label += std::string(axis ? " " : "") + mode.name;
+        }
+        fprintf(stderr, "  %s\n", label.c_str());
+
+        if (offline && offlineReferenceMs == 0.0) {
+            offlineReferenceMs = RenderOffline(reference, workload, warmup, threads).millisecondsPerFrame;
+        }
+
+        Result result;
+        result.modes = combination;
+        result.offline = offline;
+        bool isReference = std::all_of(combination.begin(), combination.end(), [](int mode) { return mode == 0; });
+        RunOutput run;
+        if (!isReference) run = offline ? RenderOffline(cfg, workload, warmup, threads) : RenderLive(cfg, workload, warmup, threads);
+        const RunOutput& output = isReference ? referenceRun : run;
+        result.millisecondsPerFrame = output.millisecondsPerFrame;
+        Compare(output, referenceRun, workload.width, workload.height, result);
+        results.push_back(result);
+    }
+    MarkFront(results, metric, false);
+    MarkFront(results, metric, true);
+    std::sort(results.begin(), results.end(), [](const Result& a, const Result& b) {
+        return a.millisecondsPerFrame < b.millisecondsPerFrame;
+    });
+
+    printf("%s fronts of %zu combinations, %dx%d, %zu frames, %u threads\n", metric == "depth" ? "Depth error" :
+        metric == "ssim" ? "SSIM" : "PSNR", results.size(), workload.width, workload.height, measured, threads);
+    auto printFront = [&](bool offline, double referenceMs, const char* title) {
+        printf("\n%s\n%s ms/frame  speedup  PSNR dB    SSIM  depth MAE", title, listAll ? "  " : "");
+        for (const Axis& axis : axes) printf("  %-11s", axis.name);
+        printf("\n");
+        for (const Result& result : results) {
+            if (result.offline != offline || (!listAll && !result.front)) continue;
+            if (listAll) printf("%c ", result.front ? '*' : ' ');
+            printf("%9.2f  %6.2fx  %7.2f  %6.4f  %9.5f", result.millisecondsPerFrame,
+                referenceMs / std::max(result.millisecondsPerFrame, 1e-9), result.psnr, result.ssim, result.depthError);
+            for (size_t axis = 0; axis < axes.size(); axis++) printf("  %-11s", axes[axis].modes[result.modes[axis]].name);
+            printf("\n");
+        }
+    };
+    printFront(false, referenceRun.millisecondsPerFrame, "Live: latency of one serial render per frame");
+    if (offlineReferenceMs > 0.0) {
+        printFront(true, offlineReferenceMs, "Offline look-ahead: batch renderer throughput per frame");
+    }
+
+    if (!csvPath.empty()) {
+        FILE* csv = fopen(csvPath.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "Cannot write '%s'\n", csvPath.c_str());
+            return 1;
+        }
+        fprintf(csv, "ms_per_frame,timing,psnr,ssim,depth_mae,front");
+        for (const Axis& axis : axes) fprintf(csv, ",%s", axis.name);
+        fprintf(csv, "\n");
+        for (const Result& result : results) {
+            fprintf(csv, "%.4f,%s,%.4f,%.6f,%.6f,%d", result.millisecondsPerFrame,
+                result.offline ? "throughput" : "latency", result.psnr, result.ssim, result.depthError, result.front ? 1 : 0);
+            for (size_t axis = 0; axis < axes.size(); axis++) fprintf(csv, ",%s", axes[axis].modes[result.modes[axis]].name);
+            fprintf(csv, "\n");
+        }
+        if (fclose(csv) != 0) return 1;
+    }
+    return 0;
+}
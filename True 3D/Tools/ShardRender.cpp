@@ -0,0 +1,240 @@
+// ShardRender.cpp : Splits a long BatchRender job across several worker processes.
+//
+// Usage: ShardRender [options] [BatchRender options] <input>...
+// Temporal smoothing makes analysis sequential, so one render uses one analysis thread.
+// ShardRender cuts the input into consecutive shards and renders each in its own
+// BatchRender process. A worker first analyses the overlap frames before its shard,
+// without writing them, so its smoothing history has converged by its first frame. With
+// look-ahead smoothing (lookahead_frames) the overlap covers the whole window and the
+// shards match a single render exactly.
+// Output names keep the frame numbers of the whole input. --dry-run prints the worker
+// commands instead, for running them on other machines.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+#include "../FrameSource.h"
+#include "ToolOptions.h"
+
+// History frames over which the depth of a warmed-up worker has settled to within about
+// 1e-3 of an unsharded render; the smoothing filter's memory outlasts its window
+const int OVERLAP_PER_HISTORY_FRAME = 8;
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "Usage: ShardRender [options] [BatchRender options] <input>...\n"
+        "  --shards <n>       Worker processes (default: one per core)\n"
+        "  --overlap <n>      Frames each worker analyses before its shard\n"
+        "                     (default: lookahead_frames, else %d x history_frames)\n"
+        "  --frames <n>       Render only the first n frames of the input\n"
+        "  --renderer <path>  BatchRender executable (default: next to ShardRender)\n"
+        "  --dry-run          Print the worker commands instead of running them\n"
+        "Every other option goes to each worker unchanged; see BatchRender --help.\n"
+        "Workers get an equal share of the cores unless --threads is given.\n",
+        OVERLAP_PER_HISTORY_FRAME);
+}
+
+static std::string DefaultRenderer(const std::string& self) {
+    size_t slash = self.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "" : self.substr(0, slash + 1);
+#ifdef _WIN32
+    return directory + "BatchRender.exe";
+#else
+    return directory.empty() ? "BatchRender" : directory + "BatchRender";
+#endif
+}
+
+static std::string QuoteArgument(const std::string& arg) {
+    if (!arg.empty() && arg.find_first_of(" \t\"'") == std::string::npos) return arg;
+    std::string quoted = "\"";
+    for (char c : arg) {
+        if (c == '"') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static std::string CommandLine(const std::vector<std::string>& command) {
+    std::string line;
+    for (const std::string& arg : command) line += (line.empty() ? "" : " ") + QuoteArgument(arg);
+    return line;
+}
+
+// Starts every command at once and waits for all of them; true if all exited with 0
+static bool RunAll(const std::vector<std::vector<std::string>>& commands) {
+    bool ok = true;
+#ifdef _WIN32
+    std::vector<HANDLE> processes;
+    for (const auto& command : commands) {
+        std::string line = CommandLine(command);
+        STARTUPINFOA startup = { sizeof(startup) };
+        PROCESS_INFORMATION process;
+        if (!CreateProcessA(NULL, &line[0], NULL, NULL, TRUE, 0, NULL, NULL, &startup, &process)) {
+            fprintf(stderr, "Cannot start '%s'\n", line.c_str());
+            ok = false;
+            continue;
+        }
+        CloseHandle(process.hThread);
+        processes.push_back(process.hProcess);
+    }
+    for (HANDLE process : processes) {
+        DWORD exitCode = 1;
+        WaitForSingleObject(process, INFINITE);
+        GetExitCodeProcess(process, &exitCode);
+        CloseHandle(process);
+        ok = ok && exitCode == 0;
+    }
+#else
+    std::vector<pid_t> processes;
+    for (const auto& command : commands) {
+        std::vector<char*> argv;
+        for (const std::string& arg : command) argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+
+        pid_t pid;
+        if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) {
+            fprintf(stderr, "Cannot start '%s'\n", CommandLine(command).c_str());
+            ok = false;
+            continue;
+        }
+        processes.push_back(pid);
+    }
+    for (pid_t pid : processes) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) ok = false;
+    }
+#endif
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    DepthIllusionConfig config;
+    std::vector<std::string> inputs;
+    std::vector<std::string> forwarded;
+    std::string renderer = DefaultRenderer(argv[0]);
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    unsigned shards = cores;
+    long long overlap = -1;
+    unsigned long long maxFrames = 0;
+    int rawWidth = 0, rawHeight = 0;
+    double fps = 60.0;
+    bool threadsGiven = false;
+    bool dryRun = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool error = false;
+        int optionStart = i;
+        if (ParseConfigOption(argc, argv, i, config, error)) {
+            if (error) return 2;
+            forwarded.insert(forwarded.end(), argv + optionStart, argv + i + 1);
+        }
+        else if (arg == "-h" || arg == "--help") {
+            PrintUsage();
+            return 0;
+        }
+        else if (arg == "--shards" && hasValue) shards = static_cast<unsigned>(std::max(1, atoi(argv[++i])));
+        else if (arg == "--overlap" && hasValue) overlap = std::max(0ll, atoll(argv[++i]));
+        else if (arg == "--frames" && hasValue) maxFrames = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--renderer" && hasValue) renderer = argv[++i];
+        else if (arg == "--dry-run") dryRun = true;
+        else if (arg == "--start" || arg == "--warmup" || arg == "--load-state" || arg == "--save-state") {
+            fprintf(stderr, "%s is set per worker by ShardRender\n", arg.c_str());
+            return 2;
+        }
+        else if ((arg == "-o" || arg == "--overlay" || arg == "--depth" || arg == "--size" || arg == "--fps" ||
+            arg == "--threads") && hasValue) {
+            std::string value = argv[++i];
+            if (arg == "--size" && sscanf(value.c_str(), "%dx%d", &rawWidth, &rawHeight) != 2) {
+                fprintf(stderr, "Invalid size '%s'\n", value.c_str());
+                return 2;
+            }
+            if (arg == "--fps") fps = atof(value.c_str());
+            if (arg == "--threads") threadsGiven = true;
+            forwarded.push_back(arg);
+            forwarded.push_back(value);
+        }
+        else if (arg == "-") {
+            fprintf(stderr, "stdin cannot be split into shards\n");
+            return 2;
+        }
+        else if (arg[0] != '-') {
+            AddInput(arg, inputs);
+            forwarded.push_back(arg);
+        }
+        else {
+            PrintUsage();
+            return 2;
+        }
+    }
+    if (inputs.empty()) {
+        PrintUsage();
+        return 2;
+    }
+
+    // Workers replay recordings with their recorded settings unless told otherwise
+    bool configGiven = false;
+    for (const std::string& arg : forwarded) configGiven = configGiven || arg == "--config" || arg == "--preset" || arg == "--set";
+    std::unique_ptr<FrameSource> source = OpenInputs(inputs, rawWidth, rawHeight, fps, configGiven ? nullptr : &config);
+    if (!source) return 1;
+
+    // Recordings are counted from their frame index, files by seeking over each frame;
+    // nothing is decoded
+    unsigned long long total = source->Skip(maxFrames ? maxFrames : ~0ull);
+    source.reset();
+    if (total == 0) {
+        fprintf(stderr, "No frames in the input\n");
+        return 1;
+    }
+
+    // Look-ahead smoothing only reaches lookahead_frames back, so that much overlap is exact
+    if (overlap < 0) {
+        overlap = config.lookahead_frames > 0 ? config.lookahead_frames :
+            static_cast<long long>(OVERLAP_PER_HISTORY_FRAME) * std::max(0, config.history_frames);
+    }
+    if (!config.temporal_smoothing) overlap = 0;
+    shards = static_cast<unsigned>(std::min<unsigned long long>(shards, total));
+    if (!threadsGiven) {
+        forwarded.push_back("--threads");
+        forwarded.push_back(std::to_string(std::max(1u, cores / shards)));
+    }
+
+    std::vector<std::vector<std::string>> commands;
+    for (unsigned shard = 0; shard < shards; shard++) {
+        unsigned long long first = total * shard / shards;
+        unsigned long long last = total * (shard + 1) / shards;
+        unsigned long long warmup = std::min<unsigned long long>(overlap, first);
+
+        std::vector<std::string> command(1, renderer);
+        command.insert(command.end(), forwarded.begin(), forwarded.end());
+        command.insert(command.end(), {
+            "--start", std::to_string(first),
+            "--frames", std::to_string(last - first),
+            "--warmup", std::to_string(warmup) });
+        commands.push_back(command);
+    }
+
+    if (dryRun) {
+        for (const auto& command : commands) printf("%s\n", CommandLine(command).c_str());
+        return 0;
+    }
+
+    fprintf(stderr, "%llu frames in %u shards, %lld frames of overlap\n", total, shards, overlap);
+    return RunAll(commands) ? 0 : 1;
+}
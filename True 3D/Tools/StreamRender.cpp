@@ -0,0 +1,207 @@
+// StreamRender.cpp : Renders the depth illusion over a video stream from stdin to stdout.
+//
+// Usage: StreamRender [options] < input > output
+// Input is Y4M or raw BGRA (with --size); output is the same kind of stream, so the tool
+// can sit between a decoder and an encoder:
+//   ffmpeg -i in.mp4 -f yuv4mpegpipe - | StreamRender | ffmpeg -i - out.mp4
+//
+// Three threads overlap the work: a reader decodes each frame straight into a free
+// BatchRenderer slot, the main thread analyses it, and the composite threads blur,
+// composite and write it out in order. Memory stays constant: only the renderer's
+// slots hold frames.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include "../BatchRenderer.h"
+#include "../FrameSource.h"
+#include "../Presenter.h"
+#include "../SpscQueue.h"
+#include "ToolOptions.h"
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "Usage: StreamRender [options] < input > output\n"
+        "  -i <file>          Input stream (default: - for stdin)\n"
+        "  -o <file>          Output stream (default: - for stdout)\n"
+        "  --size <W>x<H>     Frame size of raw BGRA input; without it input must be Y4M\n"
+        "  --fps <n>          Frame rate of raw input (default 60)\n"
+        "  --format <fmt>     Output: y4m or bgra (default: same as the input)\n"
+        "  --mode <mode>      composited (default): the overlay blended onto the input as\n"
+        "                     the layered window shows it; overlay: the BGRA overlay alone\n"
+        "%s"
+        "  --threads <n>      Worker threads (default: all cores)\n"
+        "  --frames <n>       Stop after n frames\n", CONFIG_OPTIONS_USAGE);
+}
+
+// Pipes default to 64 KiB on Linux, a small fraction of one frame; a larger buffer lets
+// the neighbouring processes run ahead instead of blocking on every write
+static void EnlargePipe(FILE* stream) {
+#ifdef __linux__
+    int fd = fileno(stream);
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISFIFO(info.st_mode)) fcntl(fd, F_SETPIPE_SZ, 1 << 20);
+#else
+    (void)stream;
+#endif
+}
+
+// A frame the reader has filled; a null slot marks the end of the input
+struct ReadFrame {
+    BatchRenderer::FrameBuffer buffer;
+    std::chrono::microseconds timestamp{ 0 };
+};
+
+int main(int argc, char** argv) {
+    DepthIllusionConfig config;
+    std::string inputPath = "-";
+    std::string outputPath = "-";
+    std::string outputFormat;
+    bool composited = true;
+    int rawWidth = 0, rawHeight = 0;
+    double fps = 60.0;
+    unsigned threads = std::thread::hardware_concurrency();
+    unsigned long long maxFrames = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool error = false;
+        if (ParseConfigOption(argc, argv, i, config, error)) {
+            if (error) return 2;
+        }
+        else if (arg == "-h" || arg == "--help") {
+            PrintUsage();
+            return 0;
+        }
+        else if (arg == "-i" && hasValue) inputPath = argv[++i];
+        else if (arg == "-o" && hasValue) outputPath = argv[++i];
+        else if (arg == "--format" && hasValue) outputFormat = argv[++i];
+        else if (arg == "--mode" && hasValue) {
+            std::string mode = argv[++i];
+            if (mode != "composited" && mode != "overlay") {
+                PrintUsage();
+                return 2;
+            }
+            composited = mode == "composited";
+        }
+        else if (arg == "--fps" && hasValue) fps = atof(argv[++i]);
+        else if (arg == "--threads" && hasValue) threads = static_cast<unsigned>(std::max(1, atoi(argv[++i])));
+        else if (arg == "--frames" && hasValue) maxFrames = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &rawWidth, &rawHeight) != 2) {
+                fprintf(stderr, "Invalid size '%s'\n", argv[i]);
+                return 2;
+            }
+        }
+        else {
+            PrintUsage();
+            return 2;
+        }
+    }
+    threads = std::max(1u, threads);
+
+    if (inputPath == "-") EnlargePipe(stdin);
+    if (outputPath == "-") EnlargePipe(stdout);
+
+    FileFrameSource source;
+    if (!source.Open(inputPath, rawWidth, rawHeight, fps)) {
+        fprintf(stderr, "Cannot read '%s' (raw input needs --size)\n", inputPath.c_str());
+        return 1;
+    }
+    int width = source.Width(), height = source.Height();
+
+    if (outputFormat.empty()) outputFormat = source.StreamFormat() == FileFrameSource::Format::Y4m ? "y4m" : "bgra";
+    if (outputFormat != "y4m" && outputFormat != "bgra") {
+        PrintUsage();
+        return 2;
+    }
+
+    FilePresenter output;
+    if (!output.Open(outputPath, outputFormat == "y4m" ? FilePresenter::Format::Y4m : FilePresenter::Format::Raw,
+        source.Fps(), source.ChromaShiftX(), source.ChromaShiftY())) {
+        fprintf(stderr, "Cannot write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    // Sink calls never overlap, so one blend buffer is enough. Raw overlay output is
+    // written straight from the renderer's slot.
+    std::vector<uint8_t> blended(composited ? static_cast<size_t>(width) * height * 4 : 0);
+    const std::vector<MaskRect> wholeFrame(1, MaskRect{ 0, 0, width, height });
+    unsigned long long framesWritten = 0;  // Finish waits for the sink, so this is final after it
+    auto sink = [&](const RenderedFrame& frame) {
+        const uint8_t* pixels = frame.overlay;
+        if (composited) {
+            BlendOverlay(frame.overlay, frame.source, blended.data(), static_cast<size_t>(width) * height);
+            pixels = blended.data();
+        }
+        if (!output.Present(pixels, width, height, wholeFrame)) {
+            fprintf(stderr, "Cannot write frame %llu\n", frame.index);
+            return false;
+        }
+        framesWritten++;
+        return true;
+    };
+
+    // Slots for the frames being composited and written, the one being analysed and the
+    // ones the reader has queued ahead of it
+    const size_t readAhead = 2;
+    auto start = std::chrono::steady_clock::now();
+    BatchRenderer renderer(config, width, height, sink, threads, threads + 1 + readAhead);
+
+    SpscQueue<ReadFrame, 4> readQueue;
+    std::atomic<bool> stop{ false };
+    std::thread reader([&] {
+        for (unsigned long long frames = 0; maxFrames == 0 || frames < maxFrames; frames++) {
+            BatchRenderer::FrameBuffer buffer = renderer.Acquire();
+            if (!buffer.pixels) break;
+
+            FrameView view;
+            if (!source.NextFrameInto(buffer.pixels, view)) {
+                renderer.Release(buffer);
+                break;
+            }
+            ReadFrame frame;
+            frame.buffer = buffer;
+            frame.timestamp = view.timestamp;
+            if (!readQueue.Push(frame, stop)) {
+                renderer.Release(buffer);
+                return;
+            }
+        }
+        readQueue.Push(ReadFrame(), stop);
+    });
+
+    bool ok = true;
+    ReadFrame frame;
+    while (readQueue.Pop(frame, stop) && frame.buffer.slot) {
+        if (!renderer.Submit(frame.buffer, frame.timestamp)) {
+            ok = false;
+            break;
+        }
+    }
+
+    // After a failed write the reader may still be parked on the queue
+    stop = true;
+    readQueue.WakeAll();
+    reader.join();
+    ok = renderer.Finish() && ok;
+    ok = fflush(stdout) == 0 && ok;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // Counts what reached the output, which is short of what was submitted after a failure
+    fprintf(stderr, "%s%llu frames of %dx%d in %.2f s (%.2f frames/s, %u threads)\n", ok ? "" : "Failed after ",
+        framesWritten, width, height, seconds, framesWritten / std::max(seconds, 1e-9), threads);
+    return ok ? 0 : 1;
+}
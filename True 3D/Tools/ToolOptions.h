@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "../DepthPipeline.h"
+#include "../FrameSource.h"
+#include "../Recording.h"
+
+// Settings options shared by the command-line tools
+const char* const CONFIG_OPTIONS_USAGE =
+    "  --config <file>    Settings saved by the overlay (binary DepthIllusionConfig)\n"
+    "  --preset <1-4>     Built-in preset applied on top of the settings\n"
+    "  --set <name>=<v>   Override one DepthIllusionConfig member; repeatable\n";
+
+// If argv[i] is one of the settings options, applies it to config, advances i past its
+// value and returns true. A malformed option is reported on stderr and sets error.
+inline bool ParseConfigOption(int argc, char** argv, int& i, DepthIllusionConfig& config, bool& error) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc || (arg != "--config" && arg != "--preset" && arg != "--set")) return false;
+
+    std::string value = argv[++i];
+    if (arg == "--config") {
+        if (!LoadConfigFromFile(value, config)) {
+            fprintf(stderr, "Cannot read settings from '%s'\n", value.c_str());
+            error = true;
+        }
+    }
+    else if (arg == "--preset") {
+        config = CreatePreset(atoi(value.c_str()), config);
+    }
+    else {
+        size_t equals = value.find('=');
+        if (equals == std::string::npos || !SetConfigField(config, value.substr(0, equals), value.substr(equals + 1))) {
+            fprintf(stderr, "Invalid setting '%s'\n", value.c_str());
+            error = true;
+        }
+    }
+    return true;
+}
+
+inline bool IsFrameFile(const std::string& name) {
+    static const char* extensions[] = { ".ppm", ".pam", ".y4m", ".raw", ".bgra" };
+    for (const char* extension : extensions) {
+        size_t length = strlen(extension);
+        if (name.size() > length && name.compare(name.size() - length, length, extension) == 0) return true;
+    }
+    return false;
+}
+
+// Frame files directly inside directory, sorted by name; false if it is not a directory
+inline bool ListDirectory(const std::string& directory, std::vector<std::string>& files) {
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &entry);
+    if (find == INVALID_HANDLE_VALUE) return false;
+    do {
+        if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) names.push_back(entry.cFileName);
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return false;
+    while (dirent* entry = readdir(dir)) names.push_back(entry->d_name);
+    closedir(dir);
+#endif
+
+    std::sort(names.begin(), names.end());
+    for (const std::string& name : names) {
+        if (IsFrameFile(name)) files.push_back(directory + "/" + name);
+    }
+    return true;
+}
+
+// Adds what an input argument names: a directory expands to the frame files inside it,
+// anything else (a file, or - for stdin) is taken as is
+inline void AddInput(const std::string& arg, std::vector<std::string>& inputs) {
+    if (arg == "-" || !ListDirectory(arg, inputs)) inputs.push_back(arg);
+}
+
+// The overlay is straight alpha but is presented with AC_SRC_ALPHA, so the screen shows
+// overlay + (1 - alpha) * screen per channel
+inline void BlendOverlay(const uint8_t* overlay, const uint8_t* source, uint8_t* dst, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount * 4; i += 4) {
+        int inverse = 255 - overlay[i + 3];
+        for (int c = 0; c < 3; c++) {
+            int value = overlay[i + c] + (source[i + c] * inverse + 127) / 255;
+            dst[i + c] = static_cast<uint8_t>(std::min(value, 255));
+        }
+        dst[i + 3] = 255;
+    }
+}
+
+// Opens the inputs as one stream. A single capture recording is replayed; its recorded
+// settings are copied to recordedConfig when that is given. Errors go to stderr.
+inline std::unique_ptr<FrameSource> OpenInputs(const std::vector<std::string>& inputs, int rawWidth, int rawHeight,
+    double fps, DepthIllusionConfig* recordedConfig = nullptr) {
+    if (inputs.size() == 1 && IsRecordingFile(inputs[0])) {
+        std::unique_ptr<ReplayFrameSource> replay(new ReplayFrameSource());
+        if (!replay->Open(inputs[0])) {
+            fprintf(stderr, "Cannot read recording '%s'\n", inputs[0].c_str());
+            return nullptr;
+        }
+        if (recordedConfig) replay->Config(*recordedConfig);
+        return replay;
+    }
+
+    std::unique_ptr<FileSequenceSource> sequence(new FileSequenceSource(inputs, rawWidth, rawHeight, fps));
+    if (!sequence->Open()) {
+        fprintf(stderr, "Cannot read '%s' (raw input needs --size)\n", inputs[0].c_str());
+        return nullptr;
+    }
+    return sequence;
+}
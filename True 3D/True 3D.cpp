@@ -19,6 +19,18 @@
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#include "DepthPipeline.h"
+#include "FramePacer.h"
+#include "FrameSource.h"
+#include "FrameTimings.h"
+#include "Presenter.h"
+#include "Recording.h"
+#include "SpscQueue.h"
+#include "TaskScheduler.h"
 
 #pragma comment(lib, "gdi32.lib")
 #pragma comment(lib, "user32.lib")
@@ -26,101 +38,63 @@
 
 const int SCREEN_WIDTH = GetSystemMetrics(SM_CXSCREEN);
 const int SCREEN_HEIGHT = GetSystemMetrics(SM_CYSCREEN);
-const int TARGET_FPS = 60;
-const int FRAME_DELAY = 1000 / TARGET_FPS;
-
-// Advanced configuration with more parameters
-struct DepthIllusionConfig {
-    // Basic settings
-    float depth_intensity = 250.0f;      // Overall depth effect strength
-    float edge_boost = 10.0f;           // Edge detection multiplier
-    float base_shift = 20.0f;          // Base pixel displacement amount
-    float perspective_strength = 4.5f;  // Perspective effect (stronger at screen bottom)
-    float phase = 0.0f;                // Current animation phase
-    float phase_speed = 0.1f;         // Animation speed
-    BYTE alpha = 245;                  // Global overlay transparency
-
-    // Enhanced settings
-    float vertical_shift = 0.2f;       // Vertical displacement amount
-    float color_intensity = 0.3f;      // Color separation intensity
-    float blur_radius = 2.5f;          // Depth-based blur amount
-    float luminance_influence = 1.4f;  // How much brightness affects depth
-    float texture_influence = 10.6f;    // How much texture detail affects depth
-    float motion_factor = 8.8f;        // Motion detection influence
-    float focus_distance = 0.5f;       // Normalized distance (0-1) for focus plane
-    float focus_range = 0.6f;          // Range around focus distance that appears sharp
-
-    // Dynamic animation
-    float wave_amplitude = 0.1f;       // Amplitude of wave effect
-    float wave_frequency = 0.001f;     // Frequency of wave pattern
-    bool temporal_smoothing = true;    // Enable temporal smoothing
-    int history_frames = 60;           // Number of frames to use for temporal smoothing
-
-    // Iridescent effect settings
-    bool enable_iridescence = true;    // Toggle for iridescent effect
-    float iridescence_intensity = 7.7f;// Strength of iridescent effect
-    float iridescence_speed = 1.02f;   // How quickly colors cycle
-    float iridescence_scale = 0.1f;   // Scale of the iridescent pattern
-    float hue_range = 1.0f;            // Range of hues used (1.0 = full spectrum)
-    float hue_offset = 0.0f;           // Starting hue offset
-} dcfg;
 
+// Versioned, immutable snapshots (RCU style). Writers copy the current snapshot, modify
+// the copy and publish it atomically; readers take one atomic load per frame and never
+// wait for a writer, so input handling is independent of frame time.
 template <typename T>
-T clamp(T value, T minVal, T maxVal) {
-    return std::max(minVal, std::min(value, maxVal));
-}
-
-// Convert HSV to RGB
-void HSVtoRGB(float h, float s, float v, float& r, float& g, float& b) {
-    if (s == 0.0f) {
-        r = g = b = v;
-        return;
+class SnapshotStore {
+public:
+    // A snapshot together with the version it was published under
+    struct Versioned {
+        std::shared_ptr<const T> value;
+        unsigned long long version;
+    };
+
+    SnapshotStore() : current(std::make_shared<const Entry>()) {}
+
+    // Loads the snapshot and its version in one step, so they always belong together
+    Versioned Load() const {
+        std::shared_ptr<const Entry> entry = std::atomic_load(&current);
+        return { std::shared_ptr<const T>(entry, &entry->value), entry->version };
     }
 
-    h = fmod(h, 1.0f) * 6.0f;
-    int i = static_cast<int>(h);
-    float f = h - i;
-    float p = v * (1.0f - s);
-    float q = v * (1.0f - s * f);
-    float t = v * (1.0f - s * (1.0f - f));
-
-    switch (i) {
-    case 0: r = v; g = t; b = p; break;
-    case 1: r = q; g = v; b = p; break;
-    case 2: r = p; g = v; b = t; break;
-    case 3: r = p; g = q; b = v; break;
-    case 4: r = t; g = p; b = v; break;
-    default: r = v; g = p; b = q; break;
+    std::shared_ptr<const T> Snapshot() const { return Load().value; }
+
+    // Bumped on every publish so consumers can cheaply detect changes
+    unsigned long long Version() const { return std::atomic_load(&current)->version; }
+
+    // modify returns whether it changed the copy; an unchanged copy is dropped, so
+    // readers and the version only ever see real changes
+    template <typename Fn>
+    bool Update(Fn modify) {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        auto next = std::make_shared<Entry>(*current);
+        if (!modify(next->value)) return false;
+        next->version++;
+        std::atomic_store(&current, std::shared_ptr<const Entry>(std::move(next)));
+        return true;
     }
-}
 
-// Apply iridescent effect to a color
-void ApplyIridescence(int x, int y, float depth, float time, BYTE& r, BYTE& g, BYTE& b) {
-    // Base hue derived from position and depth
-    float hue = fmod(
-        dcfg.hue_offset +
-        x * dcfg.iridescence_scale +
-        y * dcfg.iridescence_scale * 0.7f +
-        depth * 0.3f +
-        time * dcfg.iridescence_speed,
-        1.0f
-    ) * dcfg.hue_range;
-
-    // Convert original RGB to floats
-    float origR = r / 255.0f;
-    float origG = g / 255.0f;
-    float origB = b / 255.0f;
-
-    // Generate iridescent color
-    float iriR, iriG, iriB;
-    HSVtoRGB(hue, 0.9f, 0.9f, iriR, iriG, iriB);
-
-    // Blend with original color based on depth and intensity
-    float blendFactor = depth * dcfg.iridescence_intensity;
-
-    r = static_cast<BYTE>(clamp((origR * (1.0f - blendFactor) + iriR * blendFactor) * 255.0f, 0.0f, 255.0f));
-    g = static_cast<BYTE>(clamp((origG * (1.0f - blendFactor) + iriG * blendFactor) * 255.0f, 0.0f, 255.0f));
-    b = static_cast<BYTE>(clamp((origB * (1.0f - blendFactor) + iriB * blendFactor) * 255.0f, 0.0f, 255.0f));
+private:
+    struct Entry {
+        T value{};
+        unsigned long long version = 0;
+    };
+
+    std::shared_ptr<const Entry> current;
+    std::mutex writerMutex;
+};
+
+SnapshotStore<DepthIllusionConfig> g_config;
+SnapshotStore<RegionMask> g_regionMask;
+
+// Sets field to value and reports whether that changed it
+template <typename T>
+static bool Assign(T& field, T value) {
+    if (field == value) return false;
+    field = value;
+    return true;
 }
 
 // Smart pointer deleters for Windows GDI resources
@@ -134,290 +108,189 @@ using UniqueHDC = std::unique_ptr<std::remove_pointer<HDC>::type, ResourceDelete
 using UniqueBitmap = std::unique_ptr<std::remove_pointer<HBITMAP>::type, ResourceDeleter>;
 using UniqueGdiplusBitmap = std::unique_ptr<Gdiplus::Bitmap, ResourceDeleter>;
 
-// Enhanced depth analysis with temporal awareness
-class AdvancedDepthGenerator {
+// Captures the primary screen with GDI. The screen DC, memory DC and DIB section are
+// created once; a frame is a single BitBlt into the DIB, which the view points at.
+// GDI reports no damage, so every frame is fully damaged.
+class GdiFrameSource : public FrameSource {
 public:
-    AdvancedDepthGenerator() {
-        // Initialize GDI+
-        Gdiplus::GdiplusStartupInput gdiplusStartupInput;
-        Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    GdiFrameSource(int width, int height)
+        : width(width), height(height), start(std::chrono::steady_clock::now()) {
+        hdcScreen = GetDC(NULL);
+        hdcMem.reset(CreateCompatibleDC(hdcScreen));
+        hBitmap.reset(CreateTopDownDib(width, height, &bits));
+        SelectObject(hdcMem.get(), hBitmap.get());
+
+        hdcProbe.reset(CreateCompatibleDC(hdcScreen));
+        hProbeBitmap.reset(CreateTopDownDib(PROBE_WIDTH, PROBE_HEIGHT, &probeBits));
+        SelectObject(hdcProbe.get(), hProbeBitmap.get());
+        SetStretchBltMode(hdcProbe.get(), COLORONCOLOR);  // Point-sample, no blending
     }
 
-    ~AdvancedDepthGenerator() {
-        Gdiplus::GdiplusShutdown(gdiplusToken);
+    ~GdiFrameSource() override {
+        hdcProbe.reset();
+        hdcMem.reset();
+        if (hdcScreen) ReleaseDC(NULL, hdcScreen);
     }
 
-    void Analyze(BYTE* pixels, int width, int height) {
-        std::vector<std::vector<float>> currentDepthMap(height, std::vector<float>(width, 0.0f));
-        std::vector<std::vector<float>> luminanceMap(height, std::vector<float>(width, 0.0f));
-        std::vector<std::vector<float>> textureMap(height, std::vector<float>(width, 0.0f));
+    GdiFrameSource(const GdiFrameSource&) = delete;
+    GdiFrameSource& operator=(const GdiFrameSource&) = delete;
 
-        // Extract luminance and perform advanced edge detection
-        for (int y = 2; y < height - 2; y++) {
-            for (int x = 2; x < width - 2; x++) {
-                int offset = (y * width + x) * 4;
+    bool NextFrame(FrameView& view) override {
+        if (!bits || !BitBlt(hdcMem.get(), 0, 0, width, height, hdcScreen, 0, 0, SRCCOPY)) return false;
+        GdiFlush();  // The DIB is read directly, so the blit must have landed
 
-                // Calculate luminance
-                float luminance = 0.299f * pixels[offset + 2] + // Red
-                    0.587f * pixels[offset + 1] + // Green
-                    0.114f * pixels[offset];      // Blue
-                luminanceMap[y][x] = luminance / 255.0f;
+        auto now = std::chrono::steady_clock::now();
+        view.pixels = static_cast<const uint8_t*>(bits);
+        view.width = width;
+        view.height = height;
+        view.stride = static_cast<size_t>(width) * 4;
+        view.index = index++;
+        view.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(now - start);
+        view.fullDamage = true;
+        view.damage.clear();
+        return true;
+    }
 
-                // Multi-scale edge detection
-                CalculateEdgeStrength(pixels, width, height, x, y, textureMap);
-            }
+    // Hash of a point-sampled thumbnail of the screen: a change probe costing a small
+    // fraction of NextFrame. Changes too small to hit a sample go unnoticed. 0 on failure.
+    unsigned long long Probe() {
+        if (!probeBits || !StretchBlt(hdcProbe.get(), 0, 0, PROBE_WIDTH, PROBE_HEIGHT,
+            hdcScreen, 0, 0, width, height, SRCCOPY)) {
+            return 0;
         }
+        GdiFlush();
+        return HashFrame(static_cast<const uint8_t*>(probeBits), static_cast<size_t>(PROBE_WIDTH) * PROBE_HEIGHT * 4);
+    }
 
-        // Combine multiple cues for depth estimation
-        for (int y = 2; y < height - 2; y++) {
-            for (int x = 2; x < width - 2; x++) {
-                float depthFromTexture = textureMap[y][x] * dcfg.texture_influence;
-                float depthFromLuminance = (1.0f - luminanceMap[y][x]) * dcfg.luminance_influence;
+    int Width() const override { return width; }
+    int Height() const override { return height; }
 
-                // Apply perspective bias (objects lower in frame tend to be closer)
-                float perspectiveBias = (float)y / height * 0.2f;
+private:
+    static const int PROBE_WIDTH = 160;
+    static const int PROBE_HEIGHT = 90;
+
+    static HBITMAP CreateTopDownDib(int width, int height, void** bits) {
+        BITMAPINFO bmi = { 0 };
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = width;
+        bmi.bmiHeader.biHeight = -height;  // Top-down DIB
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+        return CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, bits, NULL, 0);
+    }
 
-                // Focus plane depth adjustment
-                float normalizedDepth = depthFromTexture + depthFromLuminance + perspectiveBias;
-                float focusAdjustment = 1.0f - std::min(
-                    std::abs(normalizedDepth - dcfg.focus_distance) / dcfg.focus_range,
-                    1.0f
-                );
+    int width;
+    int height;
+    std::chrono::steady_clock::time_point start;
+    unsigned long long index = 0;
+    HDC hdcScreen = NULL;
+    UniqueBitmap hBitmap;  // Declared before hdcMem so it outlives the DC it is selected into
+    UniqueHDC hdcMem;
+    void* bits = nullptr;
+    UniqueBitmap hProbeBitmap;
+    UniqueHDC hdcProbe;
+    void* probeBits = nullptr;
+};
 
-                // Store final depth value
-                currentDepthMap[y][x] = clamp(normalizedDepth * focusAdjustment * dcfg.depth_intensity, 0.0f, 1.0f);
-            }
-        }
+// Energy saving duty cycle for the capture loop. While captures keep coming back
+// identical, the capture/analysis interval doubles (up to idle_max_interval ticks);
+// ticks in between only re-composite the last analysis so the animation stays smooth,
+// and are skipped altogether when the animation would move less than half a pixel.
+// Any change in content, user input or configuration drops straight back to full rate;
+// the render loop probes the screen every tick, so content changes are seen within one.
+class IdleThrottle {
+public:
+    // Called every paced tick; activity forces a capture on this tick
+    bool ShouldCapture(const DepthIllusionConfig& cfg, bool activity) {
+        ticksSinceCapture++;
+        if (!cfg.power_saving || activity) interval = 1;
+        return ticksSinceCapture >= interval;
+    }
 
-        // Temporal smoothing
-        if (dcfg.temporal_smoothing && !depthHistory.empty()) {
-            ApplyTemporalSmoothing(currentDepthMap, width, height);
+    // Reports whether the capture just taken differs from the previous one
+    void OnCapture(const DepthIllusionConfig& cfg, bool changed) {
+        ticksSinceCapture = 0;
+        pendingPhase = 0.0f;
+        if (changed || !cfg.power_saving) {
+            interval = 1;
+            staticCaptures = 0;
         }
-
-        // Add to history
-        depthHistory.push_front(currentDepthMap);
-        if (depthHistory.size() > dcfg.history_frames) {
-            depthHistory.pop_back();
+        else if (++staticCaptures >= 4) {
+            interval = std::min(interval * 2, std::max(1, cfg.idle_max_interval));
+            staticCaptures = 0;
         }
-
-        // Update current depth map
-        depthMap = std::move(currentDepthMap);
     }
 
-    std::vector<std::vector<float>> depthMap;
-
-private:
-    void CalculateEdgeStrength(BYTE* pixels, int width, int height, int x, int y,
-        std::vector<std::vector<float>>& textureMap) {
-        int offset = (y * width + x) * 4;
-        float edge = 0;
-
-        // Multi-kernel edge detection
-        // 3x3 kernel (fine details)
-        float edge1 = 0;
-        for (int i = -1; i <= 1; i++) {
-            for (int j = -1; j <= 1; j++) {
-                if (i == 0 && j == 0) continue;
-                if (x + i >= 0 && x + i < width && y + j >= 0 && y + j < height) {
-                    int neighbor = ((y + j) * width + (x + i)) * 4;
-                    edge1 += abs(pixels[offset + 2] - pixels[neighbor + 2]) * 0.9f; // Red
-                    edge1 += abs(pixels[offset + 1] - pixels[neighbor + 1]) * 1.0f; // Green
-                    edge1 += abs(pixels[offset] - pixels[neighbor]) * 0.8f;         // Blue
-                }
-            }
-        }
-
-        // 5x5 kernel (medium details)
-        float edge2 = 0;
-        for (int i = -2; i <= 2; i++) {
-            for (int j = -2; j <= 2; j++) {
-                if (abs(i) <= 1 && abs(j) <= 1) continue; // Skip the inner 3x3
-                if (x + i >= 0 && x + i < width && y + j >= 0 && y + j < height) {
-                    int neighbor = ((y + j) * width + (x + i)) * 4;
-                    edge2 += abs(pixels[offset + 2] - pixels[neighbor + 2]) * 0.7f; // Red
-                    edge2 += abs(pixels[offset + 1] - pixels[neighbor + 1]) * 0.9f; // Green
-                    edge2 += abs(pixels[offset] - pixels[neighbor]) * 0.6f;         // Blue
-                }
-            }
+    // For ticks without a capture: whether the animation has moved far enough since the
+    // last composite to be worth re-compositing
+    bool ShouldRecomposite(const DepthIllusionConfig& cfg) {
+        pendingPhase += std::abs(cfg.phase_speed);
+
+        // Rough upper bound on visible change per radian of phase: displacement in pixels
+        // plus iridescent hue drift in 8-bit colour steps
+        int haloX, haloY;
+        CompositeHalo(cfg, haloX, haloY);
+        float sensitivity = static_cast<float>(std::max(haloX, haloY));
+        if (cfg.enable_iridescence) {
+            sensitivity += 6.0f * 255.0f * std::abs(cfg.iridescence_speed * cfg.hue_range);
         }
 
-        // Combine multi-scale edge information with weighting
-        edge = (edge1 * 0.6f + edge2 * 0.4f) / 3000.0f * dcfg.edge_boost;
-        textureMap[y][x] = clamp(pow(edge, 2.5f), 0.0f, 1.0f);
+        if (pendingPhase * sensitivity < 0.5f) return false;
+        pendingPhase = 0.0f;
+        return true;
     }
 
-    void ApplyTemporalSmoothing(std::vector<std::vector<float>>& currentMap, int width, int height) {
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                float sum = currentMap[y][x];
-                float weight = 1.0f;
-                float totalWeight = 1.0f;
-
-                // Blend with history
-                int frame = 1;
-                for (const auto& pastFrame : depthHistory) {
-                    if (frame > dcfg.history_frames) break;
-
-                    float frameWeight = 1.0f / (frame + 1);
-                    sum += pastFrame[y][x] * frameWeight;
-                    totalWeight += frameWeight;
-                    frame++;
-                }
-
-                currentMap[y][x] = sum / totalWeight;
-            }
-        }
-    }
+    int Interval() const { return interval; }
 
-    std::deque<std::vector<std::vector<float>>> depthHistory;
-    ULONG_PTR gdiplusToken;
+private:
+    int interval = 1;
+    int ticksSinceCapture = 0;
+    int staticCaptures = 0;
+    float pendingPhase = 0.0f;
 };
 
-UniqueBitmap CaptureScreen(HDC hdc) {
-    UniqueHDC hdcScreen(GetDC(NULL));
-    UniqueHDC hdcMem(CreateCompatibleDC(hdcScreen.get()));
-    UniqueBitmap hBitmap(CreateCompatibleBitmap(hdcScreen.get(), SCREEN_WIDTH, SCREEN_HEIGHT));
-
-    SelectObject(hdcMem.get(), hBitmap.get());
-    BitBlt(hdcMem.get(), 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, hdcScreen.get(), 0, 0, SRCCOPY);
-    return hBitmap;
+// Settings window handling
+HWND g_hwndSettings = NULL;
+bool g_showSettings = false;
+std::atomic<bool> g_recording{ false };  // F8: record captured frames for replay
+
+// Stage timing of the live pipeline; FrameTimingOff compiles every timer out
+using FrameTiming = FrameTimingOn;
+FrameTiming::Log g_captureTimings;  // Each log is written by one pipeline thread only
+FrameTiming::Log g_processTimings;
+FrameTiming::Log g_presentTimings;
+bool g_dumpTimingsAtExit = false;   // --timings-at-exit on the command line
+
+// A stage slower than one frame interval holds the whole pipeline below the target rate
+static uint64_t FrameBudgetNanoseconds(const DepthIllusionConfig& cfg) {
+    return static_cast<uint64_t>(1e9 / std::max(1.0f, cfg.target_fps));
 }
 
-// Apply a simple Gaussian blur based on depth
-void ApplyDepthBlur(BYTE* pixels, int width, int height, const std::vector<std::vector<float>>& depthMap) {
-    std::vector<BYTE> tempBuffer(width * height * 4);
-    memcpy(tempBuffer.data(), pixels, width * height * 4);
-
-    // Simple gaussian-like blur with variable radius based on depth
-    for (int y = 2; y < height - 2; y++) {
-        for (int x = 2; x < width - 2; x++) {
-            float depth = depthMap[y][x];
-            int blurRadius = static_cast<int>(depth * dcfg.blur_radius);
-            if (blurRadius == 0) continue;
-
-            blurRadius = std::min(blurRadius, 3); // Limit blur radius
-
-            float totalR = 0, totalG = 0, totalB = 0;
-            float totalWeight = 0;
-
-            for (int j = -blurRadius; j <= blurRadius; j++) {
-                for (int i = -blurRadius; i <= blurRadius; i++) {
-                    int nx = x + i;
-                    int ny = y + j;
-
-                    if (nx < 0 || nx >= width || ny < 0 || ny >= height) continue;
-
-                    // Gaussian-like weight
-                    float weight = exp(-(i * i + j * j) / (2.0f * blurRadius * blurRadius));
-
-                    int offset = (ny * width + nx) * 4;
-                    totalR += tempBuffer[offset + 2] * weight;
-                    totalG += tempBuffer[offset + 1] * weight;
-                    totalB += tempBuffer[offset] * weight;
-                    totalWeight += weight;
-                }
-            }
-
-            int offset = (y * width + x) * 4;
-            pixels[offset + 2] = static_cast<BYTE>(totalR / totalWeight);
-            pixels[offset + 1] = static_cast<BYTE>(totalG / totalWeight);
-            pixels[offset] = static_cast<BYTE>(totalB / totalWeight);
-        }
-    }
+// Full renders of unchanged content before its depth map stops moving: temporal smoothing
+// needs its whole history, interlaced analysis one pass over every slice. The governor may
+// interlace up to 4 ways on its own.
+static int SettleRenders(const DepthIllusionConfig& cfg) {
+    int history = cfg.temporal_smoothing ? cfg.history_frames : 1;
+    return std::max({ history, cfg.interlace_frames, 4 });
 }
 
-UniqueBitmap CreateEnhancedDepthOverlay(HDC hdc, AdvancedDepthGenerator& depthGen) {
-    BITMAPINFO bmi = { 0 };
-    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bmi.bmiHeader.biWidth = SCREEN_WIDTH;
-    bmi.bmiHeader.biHeight = -SCREEN_HEIGHT;  // Top-down DIB
-    bmi.bmiHeader.biPlanes = 1;
-    bmi.bmiHeader.biBitCount = 32;
-    bmi.bmiHeader.biCompression = BI_RGB;
-
-    void* pBits;
-    UniqueBitmap hBitmap(CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, &pBits, NULL, 0));
-
-    auto hScreen = CaptureScreen(hdc);
-    GetBitmapBits(hScreen.get(), SCREEN_WIDTH * SCREEN_HEIGHT * 4, pBits);
-
-    BYTE* pixels = static_cast<BYTE*>(pBits);
-    depthGen.Analyze(pixels, SCREEN_WIDTH, SCREEN_HEIGHT);
-
-    // Apply depth-based blur
-    ApplyDepthBlur(pixels, SCREEN_WIDTH, SCREEN_HEIGHT, depthGen.depthMap);
-
-    // Apply wave effect
-    float time = dcfg.phase;
-
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
-            float depth = depthGen.depthMap[y][x];
-            float perspective = 1.0f - (y / float(SCREEN_HEIGHT)) * dcfg.perspective_strength;
-
-            // Wave effect
-            float wave = sin(x * dcfg.wave_frequency + time) *
-                cos(y * dcfg.wave_frequency * 0.7f + time * 0.8f) *
-                dcfg.wave_amplitude * depth;
-
-            // Combined displacements
-            float shiftX = (dcfg.base_shift * depth * perspective + wave) * sin(dcfg.phase);
-            float shiftY = (dcfg.vertical_shift * depth * perspective + wave * 0.7f) * cos(dcfg.phase);
-
-            // Calculate adaptive focus effect
-            float focusEffect = 1.0f;
-            if (std::abs(depth - dcfg.focus_distance) > dcfg.focus_range) {
-                focusEffect = 0.6f; // Areas outside focus range get more extreme effect
-            }
-
-            int srcX = x + static_cast<int>(shiftX * focusEffect);
-            int srcY = y + static_cast<int>(shiftY * focusEffect);
-
-            srcX = clamp(srcX, 0, SCREEN_WIDTH - 1);
-            srcY = clamp(srcY, 0, SCREEN_HEIGHT - 1);
-
-            int srcOffset = (srcY * SCREEN_WIDTH + srcX) * 4;
-            int offset = (y * SCREEN_WIDTH + x) * 4;
-
-            // Enhanced color separation (chromatic aberration)
-            float colorSep = depth * dcfg.color_intensity;
-
-            int redX = clamp(srcX + static_cast<int>(colorSep * 3.0f), 0, SCREEN_WIDTH - 1);
-            int redY = srcY;
-            int redOffset = (redY * SCREEN_WIDTH + redX) * 4;
-
-            int blueX = clamp(srcX - static_cast<int>(colorSep * 3.0f), 0, SCREEN_WIDTH - 1);
-            int blueY = srcY;
-            int blueOffset = (blueY * SCREEN_WIDTH + blueX) * 4;
-
-            // Apply chromatic aberration
-            pixels[offset + 2] = static_cast<BYTE>(clamp(pixels[redOffset + 2] * (1.0f + colorSep * 0.5f), 0.0f, 255.0f)); // Red
-            pixels[offset + 1] = pixels[srcOffset + 1]; // Green stays at source position
-            pixels[offset + 0] = static_cast<BYTE>(clamp(pixels[blueOffset + 0] * (1.0f + colorSep * 0.3f), 0.0f, 255.0f)); // Blue
-
-            // Apply iridescent effect
-            if (dcfg.enable_iridescence) {
-                ApplyIridescence(x, y, depth, time,
-                    pixels[offset + 2],  // Red
-                    pixels[offset + 1],  // Green
-                    pixels[offset + 0]); // Blue
-            }
-
-            // Depth-based transparency
-            float depthAlpha = 0.3f + depth * 0.7f; // More transparent for areas with less depth
-            pixels[offset + 3] = static_cast<BYTE>(dcfg.alpha * depthAlpha);
-        }
-    }
-
-    dcfg.phase += dcfg.phase_speed;
-    return hBitmap;
+// Writes the stage histograms and the last few seconds of per-frame timings to the
+// working directory, named after the current time (F9, and at exit if asked for)
+static void DumpFrameTimings() {
+    SYSTEMTIME now;
+    GetLocalTime(&now);
+    char path[64];
+    snprintf(path, sizeof(path), "timings_%04d%02d%02d_%02d%02d%02d", now.wYear, now.wMonth, now.wDay,
+        now.wHour, now.wMinute, now.wSecond);
+    const FrameTiming::Log* logs[] = { &g_captureTimings, &g_processTimings, &g_presentTimings };
+    bool ok = FrameTiming::WriteCsv(std::string(path) + ".csv", std::string(path) + "_frames.csv", logs, 3);
+
+    char line[200];
+    snprintf(line, sizeof(line), ok ? "frame timings written to %s.csv\n" : "cannot write frame timings %s.csv\n", path);
+    OutputDebugStringA(line);
 }
 
-// Settings window handling
-HWND g_hwndSettings = NULL;
-std::mutex g_configMutex;
-bool g_showSettings = false;
-
 LRESULT CALLBACK SettingsProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     switch (uMsg) {
     case WM_CREATE:
@@ -425,7 +298,7 @@ LRESULT CALLBACK SettingsProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam
         CreateWindow(L"BUTTON", L"Close", WS_VISIBLE | WS_CHILD,
             10, 10, 100, 30, hwnd, (HMENU)1001, NULL, NULL);
 
-        // Add more controls for adjusting dcfg parameters
+        // Add more controls for adjusting g_config parameters
         // ...
 
         return 0;
@@ -468,55 +341,102 @@ void CreateSettingsWindow(HINSTANCE hInstance) {
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     switch (uMsg) {
     case WM_KEYDOWN:
-    {
-        std::lock_guard<std::mutex> lock(g_configMutex);
+        if (wParam == VK_F7) {
+            // Toggle skipping everything outside the work area (taskbar, docked app bars)
+            g_regionMask.Update([](RegionMask& mask) {
+                if (!mask.regions.empty()) {
+                    mask.regions.clear();
+                    mask.includeByDefault = true;
+                    return true;
+                }
+                RECT workArea;
+                SystemParametersInfo(SPI_GETWORKAREA, 0, &workArea, 0);
+                mask.includeByDefault = false;
+                MaskRect rect = { static_cast<int>(workArea.left), static_cast<int>(workArea.top),
+                    static_cast<int>(workArea.right), static_cast<int>(workArea.bottom) };
+                mask.regions.push_back({ rect, false });
+                return true;
+            });
+            return 0;
+        }
+        if (wParam == VK_F8) {
+            g_recording = !g_recording;
+            return 0;
+        }
+        if (wParam == VK_F9) {
+            DumpFrameTimings();
+            return 0;
+        }
 
-        // Real-time adjustments with more controls
+        // Keys that do not touch the config never publish a snapshot
         switch (wParam) {
-        case VK_UP: dcfg.base_shift *= 1.1f; break;
-        case VK_DOWN: dcfg.base_shift *= 0.9f; break;
-        case VK_RIGHT: dcfg.phase_speed *= 1.1f; break;
-        case VK_LEFT: dcfg.phase_speed *= 0.9f; break;
-        case 'W': dcfg.vertical_shift *= 1.1f; break;
-        case 'S': dcfg.vertical_shift *= 0.9f; break;
-        case 'A': dcfg.color_intensity *= 0.9f; break;
-        case 'D': dcfg.color_intensity *= 1.1f; break;
-        case 'Q': dcfg.wave_amplitude *= 1.1f; break;
-        case 'E': dcfg.wave_amplitude *= 0.9f; break;
-        case 'Z': dcfg.focus_distance = std::max(0.0f, dcfg.focus_distance - 0.05f); break;
-        case 'X': dcfg.focus_distance = std::min(1.0f, dcfg.focus_distance + 0.05f); break;
-        case 'C': dcfg.focus_range *= 0.9f; break;
-        case 'V': dcfg.focus_range *= 1.1f; break;
-
-            // Iridescent effect controls
-        case 'I': dcfg.enable_iridescence = !dcfg.enable_iridescence; break;
-        case 'U': dcfg.iridescence_intensity = std::max(0.0f, dcfg.iridescence_intensity - 0.05f); break;
-        case 'Y': dcfg.iridescence_intensity = std::min(1.0f, dcfg.iridescence_intensity + 0.05f); break;
-        case 'H': dcfg.hue_range = std::max(0.1f, dcfg.hue_range - 0.1f); break;
-        case 'J': dcfg.hue_range = std::min(2.0f, dcfg.hue_range + 0.1f); break;
-        case 'N': dcfg.iridescence_scale *= 0.9f; break;
-        case 'M': dcfg.iridescence_scale *= 1.1f; break;
-        case 'K': dcfg.iridescence_speed *= 0.9f; break;
-        case 'L': dcfg.iridescence_speed *= 1.1f; break;
-        case VK_OEM_COMMA: dcfg.hue_offset = fmod(dcfg.hue_offset - 0.1f, 1.0f); break;  // <
-        case VK_OEM_PERIOD: dcfg.hue_offset = fmod(dcfg.hue_offset + 0.1f, 1.0f); break; // >
-
             // Toggle settings window
         case 'O':
             g_showSettings = !g_showSettings;
             ShowWindow(g_hwndSettings, g_showSettings ? SW_SHOW : SW_HIDE);
-            break;
+            return 0;
 
             // Save/load presets
-        case '1': /* Save preset 1 */ break;
-        case '2': /* Save preset 2 */ break;
-        case '3': /* Load preset 1 */ break;
-        case '4': /* Load preset 2 */ break;
+        case '1': /* Save preset 1 */ return 0;
+        case '2': /* Save preset 2 */ return 0;
+        case '3': /* Load preset 1 */ return 0;
+        case '4': /* Load preset 2 */ return 0;
 
-        case VK_ESCAPE: PostQuitMessage(0); break;
+        case VK_ESCAPE: PostQuitMessage(0); return 0;
         }
-    }
-    return 0;
+
+        // Publishes a new config snapshot if the key changed a field; never waits for the render thread
+        g_config.Update([&](DepthIllusionConfig& dcfg) {
+            // Real-time adjustments with more controls
+            switch (wParam) {
+            case VK_UP: return Assign(dcfg.base_shift, dcfg.base_shift * 1.1f);
+            case VK_DOWN: return Assign(dcfg.base_shift, dcfg.base_shift * 0.9f);
+            case VK_RIGHT: return Assign(dcfg.phase_speed, dcfg.phase_speed * 1.1f);
+            case VK_LEFT: return Assign(dcfg.phase_speed, dcfg.phase_speed * 0.9f);
+            case 'F': // Cycle target frame rate
+                return Assign(dcfg.target_fps, dcfg.target_fps < 60.0f ? 60.0f : dcfg.target_fps < 120.0f ? 120.0f :
+                    dcfg.target_fps < 144.0f ? 144.0f : 30.0f);
+            case 'W': return Assign(dcfg.vertical_shift, dcfg.vertical_shift * 1.1f);
+            case 'S': return Assign(dcfg.vertical_shift, dcfg.vertical_shift * 0.9f);
+            case 'A': return Assign(dcfg.color_intensity, dcfg.color_intensity * 0.9f);
+            case 'D': return Assign(dcfg.color_intensity, dcfg.color_intensity * 1.1f);
+            case 'Q': return Assign(dcfg.wave_amplitude, dcfg.wave_amplitude * 1.1f);
+            case 'E': return Assign(dcfg.wave_amplitude, dcfg.wave_amplitude * 0.9f);
+            case 'Z': return Assign(dcfg.focus_distance, std::max(0.0f, dcfg.focus_distance - 0.05f));
+            case 'X': return Assign(dcfg.focus_distance, std::min(1.0f, dcfg.focus_distance + 0.05f));
+            case 'C': return Assign(dcfg.focus_range, dcfg.focus_range * 0.9f);
+            case 'V': return Assign(dcfg.focus_range, dcfg.focus_range * 1.1f);
+
+                // Iridescent effect controls
+            case 'I': return Assign(dcfg.enable_iridescence, !dcfg.enable_iridescence);
+            case 'U': return Assign(dcfg.iridescence_intensity, std::max(0.0f, dcfg.iridescence_intensity - 0.05f));
+            case 'Y': return Assign(dcfg.iridescence_intensity, std::min(1.0f, dcfg.iridescence_intensity + 0.05f));
+            case 'H': return Assign(dcfg.hue_range, std::max(0.1f, dcfg.hue_range - 0.1f));
+            case 'J': return Assign(dcfg.hue_range, std::min(2.0f, dcfg.hue_range + 0.1f));
+            case 'N': return Assign(dcfg.iridescence_scale, dcfg.iridescence_scale * 0.9f);
+            case 'M': return Assign(dcfg.iridescence_scale, dcfg.iridescence_scale * 1.1f);
+            case 'K': return Assign(dcfg.iridescence_speed, dcfg.iridescence_speed * 0.9f);
+            case 'L': return Assign(dcfg.iridescence_speed, dcfg.iridescence_speed * 1.1f);
+            case VK_OEM_COMMA: return Assign(dcfg.hue_offset, fmodf(dcfg.hue_offset - 0.1f, 1.0f));  // <
+            case VK_OEM_PERIOD: return Assign(dcfg.hue_offset, fmodf(dcfg.hue_offset + 0.1f, 1.0f)); // >
+
+                // Amortised analysis controls
+            case 'B': return Assign(dcfg.interlace_frames, dcfg.interlace_frames >= 4 ? 1 : dcfg.interlace_frames * 2);
+            case 'G': return Assign(dcfg.interlace_checkerboard, !dcfg.interlace_checkerboard);
+            case 'T': return Assign(dcfg.adaptive_quality, !dcfg.adaptive_quality);
+            case 'P': return Assign(dcfg.power_saving, !dcfg.power_saving);
+            case 'R': // Cycle render scale
+                return Assign(dcfg.render_scale, dcfg.render_scale > 0.75f ? 0.75f : dcfg.render_scale > 0.5f ? 0.5f :
+                    dcfg.render_scale > 0.25f ? 0.25f : 1.0f);
+
+                // Foveated processing controls
+            case VK_F5: return Assign(dcfg.foveated, !dcfg.foveated);
+            case VK_F6: return Assign(dcfg.fovea_follow_cursor, !dcfg.fovea_follow_cursor);
+
+            default: return false;
+            }
+        });
+        return 0;
 
     case WM_DESTROY:
         PostQuitMessage(0);
@@ -525,47 +445,425 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
 }
 
-void RenderThreadFunc(HWND hwnd) {
-    AdvancedDepthGenerator depthGen;
-    UniqueHDC hdc(GetDC(hwnd));
-    auto lastFrameTime = std::chrono::steady_clock::now();
+// Pooled frame buffer handed between the render pipeline stages
+struct PipelineFrame {
+    std::vector<BYTE> pixels;   // Capture buffer, valid only when capturedPixels is set
+    std::vector<BYTE> overlay;  // Composited overlay, overlayWidth x overlayHeight
+    int overlayWidth = 0;
+    int overlayHeight = 0;
+    unsigned long long index = 0;
+    std::chrono::steady_clock::time_point captured, processed, presented;
+    uint64_t frameBudget = 0;   // Nanoseconds per frame at the target rate when captured
+    float captureTime = 0.0f;   // Time spent capturing this frame (milliseconds)
+    bool recomposite = false;   // Content unchanged: reuse as much of the last frame as the config allows
+    bool capturedPixels = false; // pixels holds this tick's capture
+    int skippedTicks = 0;       // Paced ticks dropped since the previous frame
+    POINT focus = { 0, 0 };     // Foveation focus point when the frame was captured
+};
 
-    while (true) {
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now - lastFrameTime).count();
+const int PIPELINE_POOL_SIZE = 4;  // Frames in flight across all stages
+using FrameQueue = SpscQueue<PipelineFrame*, 8>;
+
+// Most recent per-frame timings (milliseconds). Stage times are the work each stage did
+// for a frame, excluding time spent waiting in queues; latency is capture to present.
+struct PipelineStats {
+    std::atomic<float> latency{ 0.0f };
+    std::atomic<float> captureTime{ 0.0f };
+    std::atomic<float> processTime{ 0.0f };
+    std::atomic<float> presentTime{ 0.0f };
+    std::atomic<float> renderStageTime[STAGE_COUNT] = {};  // CPU time per tile stage
+    std::atomic<int> qualityTier{ 0 };
+    std::atomic<int> flatTiles{ 0 };
+    std::atomic<float> dirtyFraction{ 0.0f };  // Share of the screen uploaded by the presenter
+    std::atomic<int> captureInterval{ 1 };
+    std::atomic<unsigned long long> missedDeadlines{ 0 };
+    std::atomic<unsigned long long> framesPresented{ 0 };
+} g_pipelineStats;
+
+static float MillisecondsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<float, std::milli>(to - from).count();
+}
+
+static uint64_t NanosecondsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+}
+
+// Analysis, blur and compositing run as one tile task graph so tiles flow through
+// all of them without waiting for the rest of the frame
+void ProcessStage(FrameQueue& input, FrameQueue& output, const std::atomic<bool>& stop) {
+    DepthPipeline pipeline(SCREEN_WIDTH, SCREEN_HEIGHT);
+    QualityGovernor governor;
+    // Last captured screen. Captured frames swap their pixels in, so frames that were not
+    // captured this tick re-render from it and never from a pool buffer's stale contents.
+    std::vector<BYTE> source(static_cast<size_t>(SCREEN_WIDTH) * SCREEN_HEIGHT * 4);
+    bool haveSource = false;
+    PipelineFrame* frame;
+
+    while (input.Pop(frame, stop)) {
+        auto start = std::chrono::steady_clock::now();
+        const DepthIllusionConfig snapshot = *g_config.Snapshot();
+        DepthIllusionConfig cfg = snapshot;
+        governor.Apply(cfg);
+
+        if (frame->capturedPixels) {
+            source.swap(frame->pixels);
+            haveSource = true;
+        }
+
+        pipeline.AdvancePhase(cfg.phase_speed * frame->skippedTicks);
+        pipeline.SetFocusPoint(frame->focus.x, frame->focus.y);
+        pipeline.SetRegionMask(g_regionMask.Snapshot());
+        if (frame->recomposite && pipeline.Recomposite(cfg, frame->overlay.data(),
+            frame->capturedPixels ? source.data() : nullptr)) {
+            frame->overlayWidth = pipeline.OutputWidth();
+            frame->overlayHeight = pipeline.OutputHeight();
+            // Cheap frames say nothing about the cost of a full one; keep them out of the governor
+            frame->processed = std::chrono::steady_clock::now();
+            FrameTiming::Record(g_processTimings, TIMED_PROCESS, frame->index, NanosecondsBetween(start, frame->processed),
+                frame->frameBudget);
+            if (!output.Push(frame, stop)) break;
+            continue;
+        }
+
+        if (!haveSource) {
+            // Nothing captured yet to render from; the presenter skips frames without an overlay
+            frame->overlayWidth = frame->overlayHeight = 0;
+            frame->processed = std::chrono::steady_clock::now();
+            if (!output.Push(frame, stop)) break;
+            continue;
+        }
+
+        pipeline.Render(cfg, source.data(), frame->overlay.data());
+        frame->overlayWidth = pipeline.OutputWidth();
+        frame->overlayHeight = pipeline.OutputHeight();
+        frame->processed = std::chrono::steady_clock::now();
 
-        if (elapsed >= FRAME_DELAY) {
-            UniqueBitmap hBitmap;
+        // Throughput is bounded by the slowest stage, so that is what the governor budgets
+        float processTime = MillisecondsBetween(start, frame->processed);
+        governor.Update(snapshot, std::max({ frame->captureTime, processTime, g_pipelineStats.presentTime.load() }));
 
-            {
-                std::lock_guard<std::mutex> lock(g_configMutex);
-                hBitmap = CreateEnhancedDepthOverlay(hdc.get(), depthGen);
+        g_pipelineStats.processTime = processTime;
+        g_pipelineStats.qualityTier = governor.Tier();
+        g_pipelineStats.flatTiles = pipeline.FlatTiles();
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            g_pipelineStats.renderStageTime[stage] = pipeline.StageMilliseconds(stage);
+        }
+
+        FrameTiming::Record(g_processTimings, TIMED_PROCESS, frame->index, NanosecondsBetween(start, frame->processed),
+            frame->frameBudget);
+
+        // Tile stages overlap on the workers, so they are timed as CPU time with no deadline
+        if (FrameTiming::enabled) {
+            const struct { TimedStage timed; float milliseconds; } tileStages[] = {
+                { TIMED_ANALYSIS, pipeline.StageMilliseconds(STAGE_EDGES) + pipeline.StageMilliseconds(STAGE_DEPTH) },
+                { TIMED_SMOOTHING, pipeline.StageMilliseconds(STAGE_SMOOTHING) },
+                { TIMED_BLUR, pipeline.StageMilliseconds(STAGE_BLUR) },
+                { TIMED_COMPOSITE, pipeline.StageMilliseconds(STAGE_COMPOSITE) },
+            };
+            for (const auto& stage : tileStages) {
+                FrameTiming::Record(g_processTimings, stage.timed, frame->index, static_cast<uint64_t>(stage.milliseconds * 1e6f));
             }
+        }
 
-            UniqueHDC hdcMem(CreateCompatibleDC(hdc.get()));
-            SelectObject(hdcMem.get(), hBitmap.get());
+        if (!output.Push(frame, stop)) break;
+    }
+}
 
-            POINT ptZero = { 0 };
-            SIZE size = { SCREEN_WIDTH, SCREEN_HEIGHT };
-            BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+// Presents into the layered overlay window. Its surface is a DIB section kept for the
+// whole session; only dirty rectangles are copied into it, and only their bounding box
+// is handed to UpdateLayeredWindowIndirect. Unchanged frames are not uploaded at all.
+class GdiPresenter : public Presenter {
+public:
+    GdiPresenter(HWND hwnd, HDC hdc, int width, int height)
+        : hwnd(hwnd), hdc(hdc), width(width), height(height) {
+        BITMAPINFO bmi = { 0 };
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = width;
+        bmi.bmiHeader.biHeight = -height;  // Top-down DIB
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+
+        hBitmap.reset(CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, &bits, NULL, 0));
+        hdcMem.reset(CreateCompatibleDC(hdc));
+        SelectObject(hdcMem.get(), hBitmap.get());
+    }
+
+    GdiPresenter(const GdiPresenter&) = delete;
+    GdiPresenter& operator=(const GdiPresenter&) = delete;
+
+    bool Present(const uint8_t* pixels, int frameWidth, int frameHeight, const std::vector<MaskRect>& dirty) override {
+        if (!bits || frameWidth != width || frameHeight != height) return false;
+        if (dirty.empty()) return true;
 
-            UpdateLayeredWindow(hwnd, hdc.get(), &ptZero, &size, hdcMem.get(),
-                &ptZero, 0, &blend, ULW_ALPHA);
+        CopyDirtyRects(pixels, width, dirty, static_cast<uint8_t*>(bits), static_cast<size_t>(width) * 4);
+        GdiFlush();
+
+        RECT bounds = { dirty[0].left, dirty[0].top, dirty[0].right, dirty[0].bottom };
+        for (const MaskRect& r : dirty) {
+            bounds.left = std::min<LONG>(bounds.left, r.left);
+            bounds.top = std::min<LONG>(bounds.top, r.top);
+            bounds.right = std::max<LONG>(bounds.right, r.right);
+            bounds.bottom = std::max<LONG>(bounds.bottom, r.bottom);
+        }
 
-            lastFrameTime = now;
+        POINT ptZero = { 0 };
+        SIZE size = { width, height };
+        BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+
+        UPDATELAYEREDWINDOWINFO info = { sizeof(UPDATELAYEREDWINDOWINFO) };
+        info.hdcDst = hdc;
+        info.pptDst = &ptZero;
+        info.psize = &size;
+        info.hdcSrc = hdcMem.get();
+        info.pptSrc = &ptZero;
+        info.pblend = &blend;
+        info.dwFlags = ULW_ALPHA;
+        info.prcDirty = &bounds;
+        return UpdateLayeredWindowIndirect(hwnd, &info) != FALSE;
+    }
+
+private:
+    HWND hwnd;
+    HDC hdc;
+    int width;
+    int height;
+    void* bits = nullptr;
+    UniqueBitmap hBitmap;  // Declared before hdcMem so it outlives the DC it is selected into
+    UniqueHDC hdcMem;
+};
+
+void PresentStage(HWND hwnd, HDC hdc, FrameQueue& input, FrameQueue& freeFrames, const std::atomic<bool>& stop) {
+    GdiPresenter presenter(hwnd, hdc, SCREEN_WIDTH, SCREEN_HEIGHT);
+    DirtyRectTracker tracker;
+    BilinearUpscaler upscaler;
+    std::vector<BYTE> upscaled;  // Screen-sized overlay when rendering below native resolution
+    auto lastReport = std::chrono::steady_clock::now();
+    PipelineFrame* frame;
+
+    while (input.Pop(frame, stop)) {
+        if (frame->overlayWidth == 0) {
+            if (!freeFrames.Push(frame, stop)) break;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            ScopedStageTimer<FrameTiming> timer(g_presentTimings, TIMED_PRESENT, frame->index, frame->frameBudget);
+            const BYTE* pixels = frame->overlay.data();
+            if (frame->overlayWidth != SCREEN_WIDTH || frame->overlayHeight != SCREEN_HEIGHT) {
+                upscaled.resize(static_cast<size_t>(SCREEN_WIDTH) * SCREEN_HEIGHT * 4);
+                upscaler.Upscale(frame->overlay.data(), frame->overlayWidth, frame->overlayHeight,
+                    upscaled.data(), SCREEN_WIDTH, SCREEN_HEIGHT);
+                pixels = upscaled.data();
+            }
+
+            presenter.Present(pixels, SCREEN_WIDTH, SCREEN_HEIGHT, tracker.Update(pixels, SCREEN_WIDTH, SCREEN_HEIGHT));
+        }
+        g_pipelineStats.dirtyFraction = tracker.DirtyFraction();
+
+        frame->presented = std::chrono::steady_clock::now();
+        FrameTiming::Record(g_presentTimings, TIMED_LATENCY, frame->index, NanosecondsBetween(frame->captured, frame->presented));
+        g_pipelineStats.latency = MillisecondsBetween(frame->captured, frame->presented);
+        g_pipelineStats.captureTime = frame->captureTime;
+        g_pipelineStats.presentTime = MillisecondsBetween(start, frame->presented);
+        g_pipelineStats.framesPresented++;
+
+        if (frame->presented - lastReport >= std::chrono::seconds(1)) {
+            char line[200];
+            snprintf(line, sizeof(line), "frame %llu: latency %.1f ms (capture %.1f, process %.1f, present %.1f), "
+                "quality tier %d, %d flat tiles, %.0f%% dirty, %llu missed deadlines\n",
+                frame->index, g_pipelineStats.latency.load(), g_pipelineStats.captureTime.load(),
+                g_pipelineStats.processTime.load(), g_pipelineStats.presentTime.load(),
+                g_pipelineStats.qualityTier.load(), g_pipelineStats.flatTiles.load(),
+                g_pipelineStats.dirtyFraction.load() * 100.0f, g_pipelineStats.missedDeadlines.load());
+            OutputDebugStringA(line);
+            lastReport = frame->presented;
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (!freeFrames.Push(frame, stop)) break;
     }
 }
 
+// Starts or stops the capture recording to match g_recording. Recordings are named
+// after the time they started and go to the working directory. Stopping flushes up to
+// a pool of full-screen frames to disk, so the open recorder is handed to a closer
+// thread and capture carries on with a fresh one.
+static void UpdateRecording(std::unique_ptr<FrameRecorder>& recorder, std::vector<std::thread>& closers) {
+    char line[200];
+    if (recorder->IsOpen()) {
+        closers.emplace_back([](std::unique_ptr<FrameRecorder> stopped) {
+            char line[200];
+            bool ok = stopped->Close();
+            snprintf(line, sizeof(line), "recording stopped: %llu frames, %llu dropped%s\n",
+                stopped->FramesWritten(), stopped->FramesDropped(), ok ? "" : ", write failed");
+            OutputDebugStringA(line);
+        }, std::move(recorder));
+        recorder.reset(new FrameRecorder());
+        return;
+    }
+
+    SYSTEMTIME now;
+    GetLocalTime(&now);
+    char path[64];
+    snprintf(path, sizeof(path), "capture_%04d%02d%02d_%02d%02d%02d.t3drec", now.wYear, now.wMonth, now.wDay,
+        now.wHour, now.wMinute, now.wSecond);
+    if (recorder->Open(path, SCREEN_WIDTH, SCREEN_HEIGHT)) {
+        snprintf(line, sizeof(line), "recording to %s\n", path);
+    }
+    else {
+        snprintf(line, sizeof(line), "cannot create recording %s\n", path);
+        g_recording = false;
+    }
+    OutputDebugStringA(line);
+}
+
+// Capture -> process -> present, each on its own thread, so frame N+1 is captured
+// while frame N is processed and frame N-1 presented.
+void RenderThreadFunc(HWND hwnd) {
+    UniqueHDC hdc(GetDC(hwnd));
+    std::atomic<bool> stop{ false };
+
+    std::vector<PipelineFrame> pool(PIPELINE_POOL_SIZE);
+    FrameQueue freeFrames, captured, processed;
+    for (auto& frame : pool) {
+        frame.pixels.resize(static_cast<size_t>(SCREEN_WIDTH) * SCREEN_HEIGHT * 4);
+        frame.overlay.resize(frame.pixels.size());
+        freeFrames.TryPush(&frame);
+    }
+
+    std::thread processThread(ProcessStage, std::ref(captured), std::ref(processed), std::cref(stop));
+    std::thread presentThread(PresentStage, hwnd, hdc.get(), std::ref(processed), std::ref(freeFrames), std::cref(stop));
+
+    FramePacer pacer(g_config.Snapshot()->target_fps);
+    GdiFrameSource source(SCREEN_WIDTH, SCREEN_HEIGHT);
+    FrameView view;
+    std::unique_ptr<FrameRecorder> recorder(new FrameRecorder());
+    std::vector<std::thread> recordingClosers;
+    unsigned long long recordedConfigVersion = 0;
+    IdleThrottle throttle;
+    unsigned long long frameIndex = 0;
+    unsigned long long lastHash = 0;
+    unsigned long long lastProbe = 0;
+    int contentRenders = 0;  // Full renders of the current screen content so far
+    unsigned long long renderedVersion = ~0ull;
+    DWORD lastInputTime = 0;
+    int skippedTicks = 0;
+    PipelineFrame* frame = nullptr;  // Held over a tick when its capture was skipped
+
+    while (!stop) {
+        pacer.SetTargetFps(g_config.Snapshot()->target_fps);
+        pacer.WaitForNextFrame();
+        g_pipelineStats.missedDeadlines = pacer.MissedDeadlines();
+
+        // The config and its version are loaded together after the wait, so a key pressed
+        // meanwhile can never pair the old settings with the new version
+        const auto config = g_config.Load();
+        const DepthIllusionConfig& cfg = *config.value;
+
+        // User input or a settings change ends an idle period immediately
+        LASTINPUTINFO input = { sizeof(LASTINPUTINFO) };
+        GetLastInputInfo(&input);
+        unsigned long long version = config.version + g_regionMask.Version();
+        bool activity = input.dwTime != lastInputTime || version != renderedVersion;
+        lastInputTime = input.dwTime;
+
+        // Content changing without input (a video starting, a notification) shows up in
+        // the probe on the next tick rather than at the next throttled capture. Probing
+        // before the capture means a change can never slip in between the two unseen.
+        if (cfg.power_saving) {
+            unsigned long long probe = source.Probe();
+            activity = activity || probe != lastProbe;
+            lastProbe = probe;
+        }
+
+        if (g_recording != recorder->IsOpen()) {
+            UpdateRecording(recorder, recordingClosers);
+            recordedConfigVersion = ~0ull;
+        }
+
+        bool capture = throttle.ShouldCapture(cfg, activity);
+        g_pipelineStats.captureInterval = throttle.Interval();
+        if (!capture && !throttle.ShouldRecomposite(cfg)) {
+            skippedTicks++;
+            continue;
+        }
+
+        if (!frame && !freeFrames.Pop(frame, stop)) break;
+
+        frame->index = frameIndex;
+        frame->skippedTicks = skippedTicks;
+        frame->recomposite = !capture;
+        frame->capturedPixels = capture;
+        frame->captured = std::chrono::steady_clock::now();
+        frame->frameBudget = FrameBudgetNanoseconds(cfg);
+        frame->captureTime = 0.0f;
+        skippedTicks = 0;
+
+        frame->focus = { SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 };
+        if (cfg.fovea_follow_cursor) GetCursorPos(&frame->focus);
+
+        if (capture) {
+            ScopedStageTimer<FrameTiming> timer(g_captureTimings, TIMED_CAPTURE, frame->index, frame->frameBudget);
+
+            // A failed capture (secure desktop, display change) counts as unchanged content
+            bool grabbed = source.NextFrame(view);
+            if (grabbed) CopyFrame(view, frame->pixels.data());
+            frame->capturedPixels = grabbed;
+
+            // A settings change may need a full render, which needs a fresh capture: hold the
+            // frame and leave renderedVersion alone so the next tick captures again
+            if (!grabbed && version != renderedVersion) {
+                skippedTicks = frame->skippedTicks + 1;
+                continue;
+            }
+
+            if (grabbed && recorder->IsOpen()) {
+                if (config.version != recordedConfigVersion) {
+                    recordedConfigVersion = config.version;
+                    recorder->WriteConfig(cfg);
+                }
+                recorder->WriteFrame(view);
+            }
+
+            unsigned long long hash = grabbed && !view.Unchanged()
+                ? HashFrame(frame->pixels.data(), frame->pixels.size()) : lastHash;
+            bool changed = hash != lastHash || version != renderedVersion;
+            if (hash != lastHash) contentRenders = 0;
+
+            // Unchanged content is re-composited, but only once its depth map has settled;
+            // until then it renders in full and the throttle stays at full rate. A settings
+            // change alone keeps the analysis; the renderer decides per stage which of its
+            // cached outputs the new config invalidates.
+            bool settled = contentRenders >= SettleRenders(cfg);
+            throttle.OnCapture(cfg, changed || !settled);
+            frame->recomposite = hash == lastHash && settled;
+            if (!frame->recomposite) contentRenders++;
+            frame->captureTime = MillisecondsBetween(frame->captured, std::chrono::steady_clock::now());
+            lastHash = hash;
+            renderedVersion = version;
+        }
+
+        frameIndex++;
+        if (!captured.Push(frame, stop)) break;
+        frame = nullptr;
+    }
+
+    stop = true;
+    for (FrameQueue* queue : { &freeFrames, &captured, &processed }) queue->WakeAll();
+    processThread.join();
+    presentThread.join();
+    for (std::thread& closer : recordingClosers) closer.join();
+}
+
 int WINAPI WinMain(
     _In_ HINSTANCE hInstance,
     _In_opt_ HINSTANCE hPrevInstance,
     _In_ LPSTR lpCmdLine,
     _In_ int nCmdShow
 ) {
+    g_dumpTimingsAtExit = lpCmdLine && strstr(lpCmdLine, "--timings-at-exit") != nullptr;
+
     // Initialize GDI+
     Gdiplus::GdiplusStartupInput gdiplusStartupInput;
     ULONG_PTR gdiplusToken;
@@ -598,7 +896,7 @@ int WINAPI WinMain(
     CreateSettingsWindow(hInstance);
 
     // Configure and show the window
-    SetLayeredWindowAttributes(hwnd, 0, dcfg.alpha, LWA_ALPHA);
+    SetLayeredWindowAttributes(hwnd, 0, g_config.Snapshot()->alpha, LWA_ALPHA);
     ShowWindow(hwnd, SW_SHOW);
     UpdateWindow(hwnd);
 
@@ -613,6 +911,8 @@ int WINAPI WinMain(
         DispatchMessage(&msg);
     }
 
+    if (g_dumpTimingsAtExit) DumpFrameTimings();
+
     // Cleanup
     if (g_hwndSettings) {
         DestroyWindow(g_hwndSettings);
@@ -624,95 +924,17 @@ int WINAPI WinMain(
     return static_cast<int>(msg.wParam);
 }
 
-// Function to save configuration to file
-bool SaveConfigToFile(const std::string& filename, const DepthIllusionConfig& config) {
-    std::ofstream file(filename, std::ios::binary);
-    if (!file.is_open()) return false;
-
-    file.write(reinterpret_cast<const char*>(&config), sizeof(DepthIllusionConfig));
-    return file.good();
-}
-
-// Function to load configuration from file
-bool LoadConfigFromFile(const std::string& filename, DepthIllusionConfig& config) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) return false;
-
-    file.read(reinterpret_cast<char*>(&config), sizeof(DepthIllusionConfig));
-    return file.good();
-}
-
-// Function to create a preset with predefined settings
-DepthIllusionConfig CreatePreset(int presetId) {
-    DepthIllusionConfig preset = dcfg; // Start with current settings
-
-    switch (presetId) {
-    case 1: // Subtle effect
-        preset.depth_intensity = 20.0f;
-        preset.edge_boost = 3.0f;
-        preset.base_shift = 5.0f;
-        preset.perspective_strength = 1.0f;
-        preset.phase_speed = 0.08f;
-        preset.alpha = 150;
-        preset.color_intensity = 0.6f;
-        preset.wave_amplitude = 0.5f;
-        preset.iridescence_intensity = 0.3f;
-        break;
-
-    case 2: // Intense effect
-        preset.depth_intensity = 60.0f;
-        preset.edge_boost = 8.0f;
-        preset.base_shift = 15.0f;
-        preset.perspective_strength = 2.0f;
-        preset.phase_speed = 0.25f;
-        preset.alpha = 200;
-        preset.color_intensity = 1.8f;
-        preset.wave_amplitude = 1.8f;
-        preset.iridescence_intensity = 0.9f;
-        break;
-
-    case 3: // Psychedelic effect
-        preset.depth_intensity = 70.0f;
-        preset.edge_boost = 10.0f;
-        preset.base_shift = 20.0f;
-        preset.perspective_strength = 2.5f;
-        preset.phase_speed = 0.35f;
-        preset.alpha = 220;
-        preset.color_intensity = 2.5f;
-        preset.wave_amplitude = 2.5f;
-        preset.iridescence_intensity = 1.0f;
-        preset.hue_range = 2.0f;
-        preset.iridescence_speed = 0.25f;
-        break;
-
-    case 4: // Focus effect
-        preset.depth_intensity = 50.0f;
-        preset.edge_boost = 5.0f;
-        preset.base_shift = 12.0f;
-        preset.perspective_strength = 1.2f;
-        preset.phase_speed = 0.15f;
-        preset.alpha = 180;
-        preset.focus_distance = 0.5f;
-        preset.focus_range = 0.1f;
-        preset.blur_radius = 3.0f;
-        preset.color_intensity = 1.5f;
-        break;
-    }
-
-    return preset;
-}
-
 // Function to update the settings window based on current configuration
 void UpdateSettingsWindow() {
     if (!g_hwndSettings || !IsWindowVisible(g_hwndSettings)) return;
 
-    // Update sliders and controls with current values from dcfg
+    // Update sliders and controls with current values from g_config
     // This would be implemented to update all UI control values
     // based on the current configuration
 
     // Example:
     // SendMessage(g_hwndDepthSlider, TBM_SETPOS, TRUE, 
-    //     static_cast<LPARAM>(dcfg.depth_intensity));
+    //     static_cast<LPARAM>(g_config.Snapshot()->depth_intensity));
 
     // For a complete implementation, you would need to create
     // and track all UI controls in the settings window
@@ -720,12 +942,10 @@ void UpdateSettingsWindow() {
 
 // Function to handle settings control events
 void HandleSettingsControl(HWND hwndControl, int controlId, int notificationCode) {
-    std::lock_guard<std::mutex> lock(g_configMutex);
-
     // Example handler for a slider:
     // if (controlId == ID_DEPTH_SLIDER && notificationCode == TB_THUMBTRACK) {
     //     int pos = static_cast<int>(SendMessage(hwndControl, TBM_GETPOS, 0, 0));
-    //     dcfg.depth_intensity = static_cast<float>(pos);
+    //     g_config.Update([&](DepthIllusionConfig& cfg) { return Assign(cfg.depth_intensity, static_cast<float>(pos)); });
     // }
 
     // Similar handlers would be implemented for all settings controls
@@ -738,6 +958,7 @@ void ShowHelpDialog(HWND hwndParent) {
         L"ESC - Exit application\n"
         L"O - Toggle settings window\n\n"
         L"Arrow keys - Adjust base shift and animation speed\n"
+        L"F - Cycle target frame rate (30/60/120/144)\n"
         L"W/S - Increase/decrease vertical shift\n"
         L"A/D - Decrease/increase color intensity\n"
         L"Q/E - Increase/decrease wave amplitude\n"
@@ -749,6 +970,16 @@ void ShowHelpDialog(HWND hwndParent) {
         L"N/M - Adjust iridescence scale\n"
         L"K/L - Adjust iridescence speed\n"
         L"</> - Adjust hue offset\n\n"
+        L"B - Cycle interlaced analysis (1/2/4 frames)\n"
+        L"G - Toggle row/checkerboard interlacing\n"
+        L"T - Toggle adaptive quality governor\n"
+        L"P - Toggle power saving when the screen is static\n"
+        L"R - Cycle render scale (100/75/50/25%)\n"
+        L"F5 - Toggle foveated processing\n"
+        L"F6 - Toggle fovea on mouse cursor/screen centre\n"
+        L"F7 - Toggle skipping the taskbar and docked app bars\n"
+        L"F8 - Start/stop a capture recording\n"
+        L"F9 - Write frame timing histograms to CSV\n\n"
         L"1-4 - Load presets",
         L"3D Depth Illusion Help",
         MB_OK | MB_ICONINFORMATION);